@@ -1,2 +1,5 @@
-start /wait cmd /C "notepad" %1
-start .\BCTt.exe %1 exampleConfig.txt
\ No newline at end of file
+.\BCTt.exe --edit notepad %1 exampleConfig.txt
+REM to sign without opening an editor, use - in place of the editor:
+REM .\BCTt.exe --edit - %1 exampleConfig.txt
+REM with "BCTt.exe --server exampleConfig.txt" already running, use this instead:
+REM .\BCTt.exe --client %1
\ No newline at end of file
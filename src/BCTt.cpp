@@ -17,119 +17,665 @@
 #include <string>
 #include "string.h"
 #include "signatureConfig.h"
+#include "signingServer.h"
+#include "configWatcher.h"
+#include "mappedFile.h"
+#include "signingMessage.h"
+#include "batchSigner.h"
+#include "signingRouter.h"
+#include "messageEditor.h"
+#include "signingStats.h"
 
 #ifdef _WIN32
         #include "windows.h"
+        #include <io.h>
+        #include <fcntl.h>
 #endif
 
 using namespace std;
 
-void executeSigning(char*, char*);
+bool executeSigning(char*, char*);
+bool executeSigning(signingRouter&, char*);
+bool signFile(signingRouter&, char*);
+int runServer(char*, char*);
+int runClient(char*, char*);
+int runBatch(char*, char*, char*, char*, unsigned int);
+int runVerify(char*, char*, char*, unsigned int);
+int runPipe(char*);
+int runEdit(char*, char*, char*);
+bool readStream(FILE*, string&);
 
 int main(int argc, char* argv[])
 {
+    if (argc < 2)
+    {
+        cerr << "Usage: BCTt <message file> [config file]" << endl;
+        cerr << "       BCTt - [config file]" << endl;
+        cerr << "       BCTt --edit <editor|-> <message file> [config file]" << endl;
+        cerr << "       BCTt --server <config file> [socket]" << endl;
+        cerr << "       BCTt --client <message file> [socket]" << endl;
+        cerr << "       BCTt --batch [--threads N] <config file> <directory|wildcard|stream|-> [output] [delimiter]" << endl;
+        cerr << "       BCTt --verify [--threads N] <config file> <directory|wildcard|stream|-> [delimiter]" << endl;
+        cerr << "Any mode may be preceded by --quiet and --stats <JSON lines file|->" << endl;
+        return 1;
+    }
+
+    // options for every mode come first, and are then shifted out
+    int optionCount = 0;
+
+    while (argc > (optionCount + 1))
+    {
+        string option = argv[optionCount + 1];
+
+        if (option == "--quiet")
+        {
+            signingStats::setQuiet(true);
+            optionCount++;
+        }
+        else if (option == "--stats" && argc > (optionCount + 2))
+        {
+            if (!signingStats::setOutput(argv[optionCount + 2]))
+            {
+                cerr << "Could not open the stats file " << argv[optionCount + 2] << endl;
+                return 1;
+            }
+
+            optionCount += 2;
+        }
+        else
+            break;
+    }
+
+    argc -= optionCount;
+    argv += optionCount;
+
+    if (argc < 2)
+    {
+        cerr << "Missing the message file or mode!" << endl;
+        return 1;
+    }
+
+    string mode = argv[1];
+
+    if (mode == "--batch" || mode == "--verify")
+    {
+        // --threads N may come first, the default is one per core
+        int first = 2;
+        unsigned int threadCount = 0;
+
+        if (argc > 3 && string(argv[2]) == "--threads")
+        {
+            threadCount = (unsigned int) atoi(argv[3]);
+            first = 4;
+        }
+
+        if (argc < (first + 2))
+        {
+            cerr << "Missing argument for " << mode << "!" << endl;
+            return 1;
+        }
+
+        if (mode == "--verify")
+        {
+            char* delimiter = (char*) "";
+            if (argc > (first + 2))
+                delimiter = argv[first + 2];
+
+            return runVerify(argv[first], argv[first + 1], delimiter, threadCount);
+        }
+
+        char* output = (char*) "";
+        char* delimiter = (char*) "";
+        if (argc > (first + 2))
+            output = argv[first + 2];
+        if (argc > (first + 3))
+            delimiter = argv[first + 3];
+
+        return runBatch(argv[first], argv[first + 1], output, delimiter, threadCount);
+    }
+
+    if (mode == "--server" || mode == "--client")
+    {
+        if (argc < 3)
+        {
+            cerr << "Missing argument for " << mode << "!" << endl;
+            return 1;
+        }
+
+        char* endpoint = (char*) "";
+        if (argc > 3)
+            endpoint = argv[3];
+
+        if (mode == "--server")
+            return runServer(argv[2], endpoint);
+        else
+            return runClient(argv[2], endpoint);
+    }
+
+    if (mode == "--edit")
+    {
+        if (argc < 4)
+        {
+            cerr << "Missing argument for " << mode << "!" << endl;
+            return 1;
+        }
+
+        char* configFilePath = (char*) "";
+        if (argc > 4)
+            configFilePath = argv[4];
+
+        return runEdit(argv[2], argv[3], configFilePath);
+    }
+
+    // "-" signs stdin to stdout without touching the disk
+    if (mode == "-")
+    {
+        char* configFilePath = (char*) "";
+        if (argc > 2)
+            configFilePath = argv[2];
+
+        return runPipe(configFilePath);
+    }
+
     string filePath = argv[1];
     string configFilePathStr = "";
     char* configFilePath = (char*) configFilePathStr.c_str();
     if (argc > 2)
             configFilePath = argv[2];
 
-    cout << "File Path: " << filePath << endl;
+    if (!signingStats::isQuiet())
+        cout << "File Path: " << filePath << endl;
 
-    executeSigning((char*)filePath.c_str(), configFilePath);
+    bool signedOk = executeSigning((char*)filePath.c_str(), configFilePath);
     
-    cout << "Terminating." << endl;
+    if (!signingStats::isQuiet())
+        cout << "Terminating." << endl;
 
-    return 0;
+    return signedOk ? 0 : 1;
 }
 
 /********************************************************
-* executeSigning creates a signatureConfig object, 
-* and uses it to sign the tampered message
-* It then re-writes the message with the new signature.
+* runServer parses the configuration file once and then
+* re-signs every message path sent to it by a client.
+* The configuration is reloaded whenever the file changes.
 *********************************************************/
 
-void executeSigning(char* filePath, char* configFilePath)
+int runServer(char* configFilePath, char* endpoint)
 {
-    signatureConfig signer;
-    if (configFilePath != "")
-            signer.setConfigFilePath(configFilePath);
+    configWatcher configs(configFilePath);
+
+    if (!configs.load())
+    {
+        cerr << "Not starting the signing server." << endl;
+        return 1;
+    }
+
+    // changes to the configuration file are picked up without a restart
+    configs.start();
 
-    signer.parseConfigFile();
+    signingServer server(&configs, executeSigning);
+    server.setEndpoint(endpoint);
 
-    string signatureOutput = signer.createSignature(filePath);
-    string oldSignature = signer.getOldSignature();
-    string signatureParameter = signer.getSignatureParameter();
+    if (!signingStats::isQuiet())
+        cout << "Listening on " << server.getEndpoint() << endl;
 
-    // now we have to find and replace the original signature in the file.
+    bool served = server.run();
+
+    configs.stop();
+
+    return served ? 0 : 1;
+}
+
+/********************************************************
+* runClient hands a message to a running signing server
+* in place of calling executeSigning directly.
+* The server may run in another directory, so the path
+* is made absolute first.
+*********************************************************/
 
-    string search_string = signatureParameter + oldSignature;
+int runClient(char* filePath, char* endpoint)
+{
+    string messagePath = filePath;
+
+#ifdef _WIN32
+    char fullPath[_MAX_PATH];
+    if (_fullpath(fullPath, filePath, _MAX_PATH) != NULL)
+        messagePath = fullPath;
+#else
+    char* fullPath = realpath(filePath, NULL);
+    if (fullPath != NULL)
+    {
+        messagePath = fullPath;
+        free(fullPath);
+    }
+#endif
+
+    if (!signingServer::sendRequest(endpoint, messagePath))
+    {
+        cerr << "The signing server could not re-sign " << messagePath << endl;
+        return 1;
+    }
+
+    return 0;
+}
 
-    cout << search_string << endl;
+/*************************************************************
+* runBatch applies one configuration to many messages.
+* A directory or wildcard input re-signs each file, into the
+* output directory if one is given or else in place.
+* Any other input is a stream of messages separated by the
+* delimiter line, "-" being stdin, and is written to the
+* output file, or stdout if none is given.
+* The messages are signed on threadCount threads, 0 meaning
+* one per core.
+**************************************************************/
 
-    string replace_string = signatureParameter + signatureOutput;
+int runBatch(char* configFilePath, char* input, char* output, char* delimiter, unsigned int threadCount)
+{
+    string inputPath = input;
+    string outputPath = output;
+    vector<string> inputFiles;
 
-    cout << replace_string << endl;
+    bool fileBatch = (inputPath != "-" && batchSigner::findInputFiles(inputPath, inputFiles));
+    bool toStdout = (!fileBatch && (outputPath == "" || outputPath == "-"));
 
-    string inbuf = "";
+    // the signed messages own stdout, so progress goes to stderr
+    streambuf* coutBuffer = cout.rdbuf();
+    if (toStdout)
+        cout.rdbuf(cerr.rdbuf());
 
-    ifstream messageFile;
-    messageFile.open(filePath);
-    ofstream tempFileOut("temp_message.txt");
+    int result = 1;
+    signingRouter router;
 
-    if (!messageFile.is_open() )
+    if (router.load(configFilePath))
     {
-            cerr << "Error opening message file for signature replacement!" << endl;
+        batchSigner batch(&router);
+        batch.setDelimiter(delimiter);
+        batch.setThreadCount(threadCount);
+
+        if (fileBatch)
+            batch.signFiles(inputFiles, outputPath);
+        else
+        {
+            mappedFile streamFile;
+            string streamBuffer;
+            const char* streamData = NULL;
+            size_t streamSize = 0;
+            bool streamOk = true;
+
+            if (inputPath == "-")
+            {
+                streamOk = readStream(stdin, streamBuffer);
+                streamData = streamBuffer.data();
+                streamSize = streamBuffer.length();
+            }
+            else if (outputPath == inputPath)
+            {
+                cerr << "A message stream can not be re-signed in place!" << endl;
+                streamOk = false;
+            }
+            else if (streamFile.load(input))
+            {
+                streamData = streamFile.getData();
+                streamSize = streamFile.getSize();
+            }
+            else
+                streamOk = false;
+
+            FILE* outputFile = stdout;
+
+            if (!toStdout && streamOk)
+                outputFile = fopen(output, "wb");
+
+            if (!streamOk || outputFile == NULL)
+                cerr << "Error opening the message stream!" << endl;
+            else
+            {
+#ifdef _WIN32
+                if (toStdout)
+                    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+                batch.signStream(streamData, streamSize, outputFile);
+
+                if (toStdout)
+                    fflush(stdout);
+                else
+                    fclose(outputFile);
+            }
+        }
+
+        cerr << "Signed " << batch.getSignedCount() << " messages, " << batch.getFailedCount() << " failed." << endl;
+
+        if (signingStats::isEnabled())
+            router.getStats().writeSummary(stderr);
+
+        if (batch.getSignedCount() > 0 && batch.getFailedCount() == 0)
+            result = 0;
     }
-      else
-      {
-        getline(messageFile, inbuf);    // have one before the while loop to prime it to fix eof problems
-        
-        while (!messageFile.eof())
+
+    cout.rdbuf(coutBuffer);
+
+    return result;
+}
+
+/*************************************************************
+* runVerify checks which captured messages carry a signature
+* made with the configuration, rewriting none of them.
+* The input is taken the same way as runBatch takes it, a
+* single message file being a stream of one. The messages
+* that do not match are listed on stdout.
+* It returns 0 only if every message matched.
+**************************************************************/
+
+int runVerify(char* configFilePath, char* input, char* delimiter, unsigned int threadCount)
+{
+    string inputPath = input;
+    vector<string> inputFiles;
+
+    bool fileBatch = (inputPath != "-" && batchSigner::findInputFiles(inputPath, inputFiles));
+
+    // a line per message would bury the list of mismatches
+    signingStats::setQuiet(true);
+
+    int result = 1;
+    signingRouter router;
+
+    if (!router.load(configFilePath))
+        return result;
+
+    batchSigner batch(&router);
+    batch.setDelimiter(delimiter);
+    batch.setThreadCount(threadCount);
+
+    if (fileBatch)
+        batch.verifyFiles(inputFiles, stdout);
+    else
+    {
+        mappedFile streamFile;
+        string streamBuffer;
+
+        if (inputPath == "-")
         {
-          int spot = inbuf.find(search_string);
-          if(spot >= 0)
-          {
-            string tmpstring = inbuf.substr(0,spot);
-            tmpstring += replace_string;
-            tmpstring += inbuf.substr(spot+search_string.length(), inbuf.length());
-            inbuf = tmpstring;
-          }
-
-          tempFileOut << inbuf << endl;
-          getline(messageFile, inbuf);
+            if (readStream(stdin, streamBuffer))
+                batch.verifyStream(streamBuffer.data(), streamBuffer.length(), stdout);
+            else
+                cerr << "Error reading the messages from stdin!" << endl;
         }
+        else if (streamFile.load(input))
+            batch.verifyStream(streamFile.getData(), streamFile.getSize(), stdout);
+        else
+            cerr << "Error opening the message stream!" << endl;
+    }
+
+    fflush(stdout);
+
+    cerr << "Verified " << batch.getMatchedCount() << " messages, " << batch.getMismatchCount() << " did not match, "
+         << batch.getFailedCount() << " could not be checked." << endl;
 
-        messageFile.close();
-      }
+    if (signingStats::isEnabled())
+        router.getStats().writeSummary(stderr);
+
+    if (batch.getMatchedCount() > 0 && batch.getMismatchCount() == 0 && batch.getFailedCount() == 0)
+        result = 0;
+
+    return result;
+}
+
+/************************************************************
+* runPipe reads one message from stdin, re-signs it and
+* writes it to stdout. Nothing is written to disk, so any
+* number of these can run at once, chained with pipes.
+* Progress goes to stderr. A message that can not be signed
+* is not written, and the exit code is 1.
+*************************************************************/
+
+int runPipe(char* configFilePath)
+{
+    // the signed message owns stdout, so progress goes to stderr
+    streambuf* coutBuffer = cout.rdbuf();
+    cout.rdbuf(cerr.rdbuf());
 
-    tempFileOut.close();
+    int result = 1;
+    signingRouter router;
+    if (strlen(configFilePath) == 0)
+        configFilePath = (char*) "config.txt";
 
-    ifstream tempFileIn;
-    tempFileIn.open("temp_message.txt");
+    string messageBuffer;
+    signingStats& stats = router.getStats();
 
-    ofstream messageFileNew;
-    messageFileNew.open(filePath);
+    bool loaded = router.load(configFilePath);
+    bool messageRead = false;
 
-    if (!tempFileIn.is_open() || !messageFileNew.is_open())
+    if (loaded)
     {
-        cerr << "Error opening temporary message file!" << endl;
-        exit(1);
+        stats.startStage(signingStats::STAGE_READ);
+        messageRead = readStream(stdin, messageBuffer);
+        stats.endStage(signingStats::STAGE_READ);
     }
+
+    if (!loaded)
+        result = 1;
+    else if (!messageRead)
+        cerr << "Error reading the message from stdin!" << endl;
     else
     {
-        getline(tempFileIn, inbuf);
-        
-        while (!tempFileIn.eof())
+        stats.startStage(signingStats::STAGE_READ);
+        signingMessage message(messageBuffer.data(), messageBuffer.length());
+        signatureConfig* signer = router.route(message);
+        stats.endStage(signingStats::STAGE_READ);
+
+        if (signer == NULL)
+            cerr << "No signing profile matches the message!" << endl;
+        else if (!signer->signMessage(message))
+            cerr << "Could not sign the message!" << endl;
+        else
         {
-            messageFileNew << inbuf << endl;
-            getline(tempFileIn, inbuf);
+            if (!signingStats::isQuiet())
+            {
+                cerr << signer->getSignatureParameter() << signer->getOldSignature() << endl;
+                cerr << signer->getSignatureParameter() << signer->getSignature() << endl;
+            }
+
+#ifdef _WIN32
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+            stats.startStage(signingStats::STAGE_WRITE);
+
+            if (message.write(stdout) && fflush(stdout) == 0)
+                result = 0;
+            else
+                cerr << "Error writing the re-signed message!" << endl;
+
+            stats.endStage(signingStats::STAGE_WRITE);
         }
+
+        stats.endMessage("stdin", result == 0);
     }
 
-    tempFileIn.close();
-    messageFileNew.close();
-    
-    cout << "Done." << endl;
+    cout.rdbuf(coutBuffer);
+
+    return result;
 }
 
+struct editContext
+{
+    char* configFilePath;
+    bool signedOk;
+};
+
+/************************************************************
+* signSavedMessage signs a message the editor has saved.
+* A save that cannot be signed is reported, and the next
+* save is waited for all the same.
+*************************************************************/
+
+static void signSavedMessage(void* context, const char* filePath)
+{
+    editContext* edit = (editContext*) context;
+
+    if (!signingStats::isQuiet())
+        cout << "File Path: " << filePath << endl;
+
+    edit->signedOk = executeSigning((char*) filePath, edit->configFilePath);
+
+    if (!edit->signedOk)
+        cerr << "Waiting for the next save of " << filePath << endl;
+}
+
+/************************************************************
+* runEdit opens the message in an editor and signs it the
+* moment it is saved, again on every later save, and once
+* the editor is closed if it was not saved. It returns when
+* the editor exits. An editor of "-" skips editing and signs
+* straight away, and an empty one uses $VISUAL, $EDITOR or
+* the platform default.
+* It returns 1 if the message was last left unsigned.
+*************************************************************/
+
+int runEdit(char* editor, char* filePath, char* configFilePath)
+{
+    editContext edit;
+    edit.configFilePath = configFilePath;
+    edit.signedOk = true;
+
+    bool edited = true;
+
+    if (string(editor) != "-")
+    {
+        messageEditor messageEdit(editor);
+
+        if (!signingStats::isQuiet())
+            cout << "Editing " << filePath << " with " << messageEdit.getEditor() << endl;
+
+        edited = messageEdit.edit(filePath, signSavedMessage, &edit);
+    }
+    else
+        signSavedMessage(&edit, filePath);
+
+    if (!signingStats::isQuiet())
+        cout << "Terminating." << endl;
+
+    return (edited && edit.signedOk) ? 0 : 1;
+}
+
+/************************************************************
+* readStream reads everything left in a stream into buffer.
+* It returns false if the stream could not be read.
+*************************************************************/
+
+bool readStream(FILE* stream, string& buffer)
+{
+#ifdef _WIN32
+    _setmode(_fileno(stream), _O_BINARY);
+#endif
+
+    char chunk[65536];
+    size_t bytesRead = 0;
+
+    while ((bytesRead = fread(chunk, 1, sizeof(chunk), stream)) > 0)
+        buffer.append(chunk, bytesRead);
+
+    return (ferror(stream) == 0);
+}
+
+/********************************************************
+* executeSigning loads the configuration, or the routes
+* to several, and uses it to sign the tampered message.
+* It returns false if the message could not be signed.
+*********************************************************/
+
+bool executeSigning(char* filePath, char* configFilePath)
+{
+    signingRouter router;
+    if (strlen(configFilePath) == 0)
+            configFilePath = (char*) "config.txt";
+
+    if (!router.load(configFilePath))
+        return false;
+
+    return executeSigning(router, filePath);
+}
+
+/********************************************************
+* executeSigning(signingRouter&, char*) signs the
+* tampered message with the profile routed for it.
+* It then re-writes the message with the new signature.
+* It returns false if the message could not be signed.
+*********************************************************/
+
+bool executeSigning(signingRouter& router, char* filePath)
+{
+    bool signedOk = signFile(router, filePath);
+
+    router.getStats().endMessage(filePath, signedOk);
+
+    return signedOk;
+}
+
+/********************************************************
+* signFile does the work of executeSigning, timing each
+* stage of it
+*********************************************************/
+
+bool signFile(signingRouter& router, char* filePath)
+{
+    signingStats& stats = router.getStats();
+    mappedFile messageFile;
+
+    stats.startStage(signingStats::STAGE_READ);
+
+    if (!messageFile.load(filePath))
+    {
+        stats.endStage(signingStats::STAGE_READ);
+        cerr << "Error opening message file " << filePath << endl;
+        return false;
+    }
+
+    // the message is indexed once, and the same offsets are used
+    // to sign it and to replace the signature.
+    signingMessage message(messageFile.getData(), messageFile.getSize());
+    signatureConfig* signer = router.route(message);
+
+    stats.endStage(signingStats::STAGE_READ);
+
+    if (signer == NULL)
+    {
+        cerr << "No signing profile matches " << filePath << endl;
+        return false;
+    }
+
+    if (!signer->signMessage(message))
+    {
+        cerr << "Could not sign " << filePath << endl;
+        return false;
+    }
+
+    if (!signingStats::isQuiet())
+    {
+        cout << signer->getSignatureParameter() << signer->getOldSignature() << endl;
+        cout << signer->getSignatureParameter() << signer->getSignature() << endl;
+    }
+
+    stats.startStage(signingStats::STAGE_WRITE);
+
+    // the signed message is written straight from the loaded copy
+    mappedFile::atomicWrite signedFile;
+    bool written = mappedFile::beginAtomicWrite(filePath, signedFile) && message.write(signedFile.file);
+
+    messageFile.close();
+
+    written = mappedFile::endAtomicWrite(signedFile, written);
+
+    stats.endStage(signingStats::STAGE_WRITE);
+
+    if (!written)
+    {
+        cerr << "Error writing the re-signed message!" << endl;
+        return false;
+    }
+
+    if (!signingStats::isQuiet())
+        cout << "Done." << endl;
+
+    return true;
+}
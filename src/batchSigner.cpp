@@ -0,0 +1,688 @@
+/**************************************************************************
+* File: batchSigner.cpp
+*
+* This provides the implementation for batch signing.
+* Messages that fail to sign are counted and reported, and do not stop
+* the rest of the batch.
+*
+* Author: Hon1nbo
+***************************************************************************/
+
+#include "batchSigner.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+        #include "windows.h"
+#else
+        #include <sys/types.h>
+        #include <sys/stat.h>
+        #include <dirent.h>
+        #include <glob.h>
+#endif
+
+using namespace std;
+
+batchSigner::batchSigner(signingRouter* router)
+{
+    _router = router;
+    _delimiter = BCTT_DEFAULT_DELIMITER;
+    _threadCount = signingPool::getDefaultThreadCount();
+    _inputFiles = NULL;
+    _streamData = NULL;
+    _streamOutput = NULL;
+    _nextStreamResult = 0;
+    _signedCount = 0;
+    _failedCount = 0;
+    _matchedCount = 0;
+    _mismatchCount = 0;
+}
+
+batchSigner::~batchSigner()
+{
+    stopWorkers();
+}
+
+/*****************************************************************
+ * setDelimiter sets the line that separates messages in a stream,
+ * an empty string keeps the default
+ ****************************************************************/
+
+void batchSigner::setDelimiter(string delimiter)
+{
+    if (delimiter != "")
+        _delimiter = delimiter;
+}
+
+/***********************************************************
+ * getDelimiter returns the line separating stream messages
+ **********************************************************/
+
+string batchSigner::getDelimiter()
+{
+    return _delimiter;
+}
+
+/****************************************************************
+ * setThreadCount sets how many threads sign messages, 0 means
+ * one per core (the default)
+ ***************************************************************/
+
+void batchSigner::setThreadCount(unsigned int threadCount)
+{
+    _threadCount = (threadCount == 0) ? signingPool::getDefaultThreadCount() : threadCount;
+}
+
+/**********************************************************
+ * getThreadCount returns how many threads sign messages
+ *********************************************************/
+
+unsigned int batchSigner::getThreadCount()
+{
+    return _threadCount;
+}
+
+/*****************************************************
+ * getSignedCount returns how many messages were
+ * re-signed so far
+ ****************************************************/
+
+size_t batchSigner::getSignedCount()
+{
+    return _signedCount;
+}
+
+/*****************************************************
+ * getFailedCount returns how many messages could not
+ * be re-signed so far
+ ****************************************************/
+
+size_t batchSigner::getFailedCount()
+{
+    return _failedCount;
+}
+
+/*****************************************************
+ * getMatchedCount and getMismatchCount return how
+ * many messages verified, or did not, so far
+ ****************************************************/
+
+size_t batchSigner::getMatchedCount()
+{
+    return _matchedCount;
+}
+
+size_t batchSigner::getMismatchCount()
+{
+    return _mismatchCount;
+}
+
+#ifdef _WIN32
+
+/*************************************************************************
+ * findInputFiles lists the files to sign for a directory, or for a path
+ * with * or ? wildcards in its last part. The list is sorted so batches
+ * always run in the same order.
+ * It returns false if the input is neither.
+ ************************************************************************/
+
+bool batchSigner::findInputFiles(string input, vector<string>& inputFiles)
+{
+    string directory = "";
+    string pattern = input;
+    DWORD attributes = GetFileAttributesA(input.c_str());
+
+    if (attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        directory = input + "\\";
+        pattern = directory + "*";
+    }
+    else if (input.find_first_of("*?") != string::npos)
+    {
+        size_t found = input.find_last_of("\\/");
+        if (found != string::npos)
+            directory = input.substr(0, (found + 1));
+    }
+    else
+        return false;
+
+    WIN32_FIND_DATAA entry;
+    HANDLE search = FindFirstFileA(pattern.c_str(), &entry);
+
+    if (search != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            if (!(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && entry.cFileName[0] != '.')
+                inputFiles.push_back(directory + entry.cFileName);
+        }
+        while (FindNextFileA(search, &entry));
+
+        FindClose(search);
+    }
+
+    sort(inputFiles.begin(), inputFiles.end());
+
+    return true;
+}
+
+#else
+
+/*************************************************************************
+ * findInputFiles lists the files to sign for a directory, or for a path
+ * with * or ? wildcards in it. The list is sorted so batches always run
+ * in the same order.
+ * It returns false if the input is neither.
+ ************************************************************************/
+
+bool batchSigner::findInputFiles(string input, vector<string>& inputFiles)
+{
+    struct stat inputStatus;
+
+    if (stat(input.c_str(), &inputStatus) == 0 && S_ISDIR(inputStatus.st_mode))
+    {
+        DIR* directory = opendir(input.c_str());
+
+        if (directory == NULL)
+            return false;
+
+        struct dirent* entry;
+
+        while ((entry = readdir(directory)) != NULL)
+        {
+            // skips ".", ".." and hidden files
+            if (entry->d_name[0] == '.')
+                continue;
+
+            string entryPath = input + "/" + entry->d_name;
+
+            if (stat(entryPath.c_str(), &inputStatus) == 0 && S_ISREG(inputStatus.st_mode))
+                inputFiles.push_back(entryPath);
+        }
+
+        closedir(directory);
+    }
+    else if (input.find_first_of("*?[") != string::npos)
+    {
+        glob_t matches;
+
+        if (glob(input.c_str(), 0, NULL, &matches) == 0)
+        {
+            for (size_t i = 0; i < matches.gl_pathc; i++)
+            {
+                if (stat(matches.gl_pathv[i], &inputStatus) == 0 && S_ISREG(inputStatus.st_mode))
+                    inputFiles.push_back(matches.gl_pathv[i]);
+            }
+        }
+
+        globfree(&matches);
+    }
+    else
+        return false;
+
+    sort(inputFiles.begin(), inputFiles.end());
+
+    return true;
+}
+
+#endif
+
+/**********************************************************************
+ * startWorkers sets up the state of each signing thread. The first one
+ * signs with the original profiles, the others with their own
+ * copies of them.
+ *********************************************************************/
+
+void batchSigner::startWorkers(unsigned int threadCount)
+{
+    stopWorkers();
+
+    for (unsigned int i = 0; i < threadCount; i++)
+    {
+        workerState* worker = new workerState();
+        worker->router = (i == 0) ? _router : new signingRouter(*_router);
+        worker->signedCount = 0;
+        worker->failedCount = 0;
+        worker->matchedCount = 0;
+        worker->mismatchCount = 0;
+        _workers.push_back(worker);
+    }
+}
+
+/*********************************************************************
+ * stopWorkers adds up what each thread did, timings included, and
+ * frees their state
+ ********************************************************************/
+
+void batchSigner::stopWorkers()
+{
+    for (unsigned int i = 0; i < _workers.size(); i++)
+    {
+        _signedCount += _workers[i]->signedCount;
+        _failedCount += _workers[i]->failedCount;
+        _matchedCount += _workers[i]->matchedCount;
+        _mismatchCount += _workers[i]->mismatchCount;
+
+        if (_workers[i]->router != _router)
+        {
+            _router->getStats().merge(_workers[i]->router->getStats());
+            delete _workers[i]->router;
+        }
+
+        delete _workers[i];
+    }
+
+    _workers.clear();
+}
+
+/***********************************************************************
+ * signFiles re-signs every file in the list. With an output directory
+ * each result is written there under the same name, otherwise every
+ * file is re-signed in place.
+ **********************************************************************/
+
+void batchSigner::signFiles(const vector<string>& inputFiles, string outputDirectory)
+{
+    // an existing directory is fine, anything else shows up as write errors
+#ifdef _WIN32
+    if (outputDirectory != "")
+        CreateDirectoryA(outputDirectory.c_str(), NULL);
+#else
+    if (outputDirectory != "")
+        mkdir(outputDirectory.c_str(), 0777);
+#endif
+
+    _inputFiles = &inputFiles;
+    _outputPaths.clear();
+    _outputPaths.reserve(inputFiles.size());
+
+    for (size_t i = 0; i < inputFiles.size(); i++)
+    {
+        string outputPath = inputFiles[i];
+
+        if (outputDirectory != "")
+        {
+            size_t found = inputFiles[i].find_last_of("\\/");
+            string fileName = (found == string::npos) ? inputFiles[i] : inputFiles[i].substr(found + 1);
+
+#ifdef _WIN32
+            outputPath = outputDirectory + "\\" + fileName;
+#else
+            outputPath = outputDirectory + "/" + fileName;
+#endif
+        }
+
+        _outputPaths.push_back(outputPath);
+    }
+
+    signingPool pool(_threadCount);
+    startWorkers(pool.getThreadCount());
+    pool.run(inputFiles.size(), signFileTask, this);
+    stopWorkers();
+
+    _inputFiles = NULL;
+}
+
+/*******************************************************************
+ * signFileTask re-signs one message file and writes it to its
+ * output path, on whichever thread the pool runs it.
+ ******************************************************************/
+
+void batchSigner::signFileTask(void* context, unsigned int workerNumber, size_t index)
+{
+    batchSigner* batch = (batchSigner*) context;
+    workerState* worker = batch->_workers[workerNumber];
+    const string& inputPath = (*batch->_inputFiles)[index];
+    signingStats& stats = worker->router->getStats();
+    bool signedOk = false;
+
+    stats.startStage(signingStats::STAGE_READ);
+
+    if (worker->inputFile.load(inputPath.c_str()))
+    {
+        worker->message.parse(worker->inputFile.getData(), worker->inputFile.getSize());
+        signatureConfig* signer = worker->router->route(worker->message);
+        stats.endStage(signingStats::STAGE_READ);
+
+        signedOk = (signer != NULL && signer->signMessage(worker->message));
+
+        // written straight from the loaded copy of the input
+        if (signedOk)
+        {
+            stats.startStage(signingStats::STAGE_WRITE);
+
+            mappedFile::atomicWrite outputFile;
+            bool written = mappedFile::beginAtomicWrite(batch->_outputPaths[index].c_str(), outputFile)
+                    && worker->message.write(outputFile.file);
+
+            worker->inputFile.close();
+            signedOk = mappedFile::endAtomicWrite(outputFile, written);
+
+            stats.endStage(signingStats::STAGE_WRITE);
+        }
+        else
+            worker->inputFile.close();
+    }
+    else
+        stats.endStage(signingStats::STAGE_READ);
+
+    stats.endMessage(inputPath, signedOk);
+
+    if (signedOk)
+        worker->signedCount++;
+    else
+    {
+        cerr << "Could not sign " << inputPath << endl;
+        worker->failedCount++;
+    }
+}
+
+/*************************************************************************
+ * signStream re-signs every message in a buffer holding many messages,
+ * each ended by a line holding only the delimiter, and writes them all
+ * to output. Delimiter lines are copied through unchanged, and so are
+ * messages that can not be signed, so the output lines up with the input.
+ ************************************************************************/
+
+void batchSigner::signStream(const char* data, size_t size, FILE* output)
+{
+    // split the stream up first, so the messages can be signed in any order
+    splitStream(data, size);
+
+    _streamData = data;
+    _streamOutput = output;
+    _streamResults.clear();
+    _streamResults.resize(_streamMessages.size());
+    _nextStreamResult = 0;
+
+    for (size_t i = 0; i < _streamResults.size(); i++)
+        _streamResults[i].done = false;
+
+    signingPool pool(_threadCount);
+    startWorkers(pool.getThreadCount());
+    pool.run(_streamMessages.size(), signStreamTask, this);
+    stopWorkers();
+
+    _streamMessages.clear();
+    _streamResults.clear();
+    _streamData = NULL;
+    _streamOutput = NULL;
+}
+
+/***********************************************************************
+ * splitStream finds where each message of a stream starts and ends,
+ * and the delimiter line after it
+ **********************************************************************/
+
+void batchSigner::splitStream(const char* data, size_t size)
+{
+    size_t messageStart = 0;
+    size_t lineStart = 0;
+
+    _streamMessages.clear();
+
+    while (messageStart < size)
+    {
+        streamMessage message;
+        message.offset = messageStart;
+        message.length = size - messageStart;
+        message.delimiterLength = 0;
+
+        while (lineStart < size)
+        {
+            const char* lineEnd = (const char*) memchr(data + lineStart, '\n', size - lineStart);
+            size_t nextLine = (lineEnd == NULL) ? size : (size_t) (lineEnd - data) + 1;
+            size_t lineLength = ((lineEnd == NULL) ? size : (size_t) (lineEnd - data)) - lineStart;
+
+            if (lineLength > 0 && data[lineStart + lineLength - 1] == '\r')
+                lineLength--;
+
+            bool delimiter = (lineLength == _delimiter.length() && memcmp(data + lineStart, _delimiter.data(), lineLength) == 0);
+
+            if (delimiter)
+            {
+                message.length = lineStart - messageStart;
+                message.delimiterLength = nextLine - lineStart;
+                lineStart = nextLine;
+                break;
+            }
+
+            lineStart = nextLine;
+        }
+
+        _streamMessages.push_back(message);
+        messageStart = message.offset + message.length + message.delimiterLength;
+    }
+}
+
+/*******************************************************************
+ * signStreamTask re-signs one message of a stream, on whichever
+ * thread the pool runs it, and hands it over to be written.
+ ******************************************************************/
+
+void batchSigner::signStreamTask(void* context, unsigned int workerNumber, size_t index)
+{
+    batchSigner* batch = (batchSigner*) context;
+    workerState* worker = batch->_workers[workerNumber];
+    const streamMessage& message = batch->_streamMessages[index];
+    bool signedOk = false;
+
+    if (message.length > 0)
+    {
+        signingStats& stats = worker->router->getStats();
+
+        stats.startStage(signingStats::STAGE_READ);
+        worker->message.parse(batch->_streamData + message.offset, message.length);
+        signatureConfig* signer = worker->router->route(worker->message);
+        stats.endStage(signingStats::STAGE_READ);
+
+        signedOk = (signer != NULL && signer->signMessage(worker->message, worker->signedMessage));
+
+        if (signedOk)
+            worker->signedCount++;
+        else
+        {
+            cerr << "Could not sign stream message " << (index + 1) << endl;
+            worker->failedCount++;
+        }
+
+        // stream messages are written in order by whichever thread is
+        // free, so their write stage is not timed
+        if (signingStats::isEnabled())
+            stats.endMessage("stream message " + to_string(index + 1), signedOk);
+    }
+
+    batch->writeStreamResult(index, signedOk, worker->signedMessage);
+}
+
+/*************************************************************************
+ * writeStreamResult writes a finished message if every message before it
+ * has been written, followed by any later ones that were waiting on it.
+ * Otherwise the message is parked until its turn comes. Parking swaps the
+ * buffers rather than copying them.
+ ************************************************************************/
+
+void batchSigner::writeStreamResult(size_t index, bool signedOk, string& signedMessage)
+{
+    lock_guard<mutex> guard(_streamLock);
+
+    if (index != _nextStreamResult)
+    {
+        _streamResults[index].signedMessage.swap(signedMessage);
+        _streamResults[index].signedOk = signedOk;
+        _streamResults[index].done = true;
+        return;
+    }
+
+    writeStreamMessage(index, signedOk, signedMessage);
+    _nextStreamResult++;
+
+    while (_nextStreamResult < _streamResults.size() && _streamResults[_nextStreamResult].done)
+    {
+        streamResult& waiting = _streamResults[_nextStreamResult];
+
+        writeStreamMessage(_nextStreamResult, waiting.signedOk, waiting.signedMessage);
+        string().swap(waiting.signedMessage);
+        _nextStreamResult++;
+    }
+}
+
+/*****************************************************************
+ * writeStreamMessage writes one message, signed or as it came in,
+ * and the delimiter line that followed it
+ ****************************************************************/
+
+void batchSigner::writeStreamMessage(size_t index, bool signedOk, const string& signedMessage)
+{
+    const streamMessage& message = _streamMessages[index];
+
+    if (signedOk)
+        fwrite(signedMessage.data(), 1, signedMessage.length(), _streamOutput);
+    else
+        fwrite(_streamData + message.offset, 1, message.length, _streamOutput);
+
+    fwrite(_streamData + message.offset + message.length, 1, message.delimiterLength, _streamOutput);
+}
+
+/*************************************************************************
+ * verifyFiles checks every file in the list against its own signature
+ * without writing anything. The files that do not match are listed on
+ * output in the order given once all of them are checked.
+ ************************************************************************/
+
+void batchSigner::verifyFiles(const vector<string>& inputFiles, FILE* output)
+{
+    _inputFiles = &inputFiles;
+    _verifyResults.assign(inputFiles.size(), VERIFY_FAILED);
+
+    signingPool pool(_threadCount);
+    startWorkers(pool.getThreadCount());
+    pool.run(inputFiles.size(), verifyFileTask, this);
+    stopWorkers();
+
+    for (size_t i = 0; i < inputFiles.size(); i++)
+        if (_verifyResults[i] == VERIFY_MISMATCH)
+            fprintf(output, "Mismatch: %s\n", inputFiles[i].c_str());
+
+    _verifyResults.clear();
+    _inputFiles = NULL;
+}
+
+/*******************************************************************
+ * verifyFileTask checks one message file, on whichever thread the
+ * pool runs it
+ ******************************************************************/
+
+void batchSigner::verifyFileTask(void* context, unsigned int workerNumber, size_t index)
+{
+    batchSigner* batch = (batchSigner*) context;
+    workerState* worker = batch->_workers[workerNumber];
+    const string& inputPath = (*batch->_inputFiles)[index];
+    signingStats& stats = worker->router->getStats();
+    bool checked = false;
+    bool matched = false;
+
+    stats.startStage(signingStats::STAGE_READ);
+
+    if (worker->inputFile.load(inputPath.c_str()))
+    {
+        worker->message.parse(worker->inputFile.getData(), worker->inputFile.getSize());
+        signatureConfig* signer = worker->router->route(worker->message);
+        stats.endStage(signingStats::STAGE_READ);
+
+        checked = (signer != NULL && signer->verifyMessage(worker->message, matched));
+
+        worker->inputFile.close();
+    }
+    else
+        stats.endStage(signingStats::STAGE_READ);
+
+    stats.endMessage(inputPath, checked && matched);
+    batch->countVerifyResult(worker, index, checked, matched);
+
+    if (!checked)
+        cerr << "Could not verify " << inputPath << endl;
+}
+
+/*************************************************************************
+ * verifyStream checks every message in a buffer holding many messages,
+ * split up the same way as signStream, and lists the numbers of the
+ * messages that do not match on output
+ ************************************************************************/
+
+void batchSigner::verifyStream(const char* data, size_t size, FILE* output)
+{
+    splitStream(data, size);
+
+    _streamData = data;
+    _verifyResults.assign(_streamMessages.size(), VERIFY_FAILED);
+
+    signingPool pool(_threadCount);
+    startWorkers(pool.getThreadCount());
+    pool.run(_streamMessages.size(), verifyStreamTask, this);
+    stopWorkers();
+
+    for (size_t i = 0; i < _verifyResults.size(); i++)
+        if (_verifyResults[i] == VERIFY_MISMATCH)
+            fprintf(output, "Mismatch: stream message %lu\n", (unsigned long) (i + 1));
+
+    _verifyResults.clear();
+    _streamMessages.clear();
+    _streamData = NULL;
+}
+
+/*******************************************************************
+ * verifyStreamTask checks one message of a stream, on whichever
+ * thread the pool runs it
+ ******************************************************************/
+
+void batchSigner::verifyStreamTask(void* context, unsigned int workerNumber, size_t index)
+{
+    batchSigner* batch = (batchSigner*) context;
+    workerState* worker = batch->_workers[workerNumber];
+    const streamMessage& message = batch->_streamMessages[index];
+    signingStats& stats = worker->router->getStats();
+    bool checked = false;
+    bool matched = false;
+
+    // an empty message, such as after a trailing delimiter, is not counted
+    if (message.length == 0)
+        return;
+
+    stats.startStage(signingStats::STAGE_READ);
+    worker->message.parse(batch->_streamData + message.offset, message.length);
+    signatureConfig* signer = worker->router->route(worker->message);
+    stats.endStage(signingStats::STAGE_READ);
+
+    checked = (signer != NULL && signer->verifyMessage(worker->message, matched));
+
+    if (signingStats::isEnabled())
+        stats.endMessage("stream message " + to_string(index + 1), checked && matched);
+
+    batch->countVerifyResult(worker, index, checked, matched);
+
+    if (!checked)
+        cerr << "Could not verify stream message " << (index + 1) << endl;
+}
+
+/*********************************************************************
+ * countVerifyResult records how one message verified. Each message
+ * has its own slot, so no lock is needed.
+ ********************************************************************/
+
+void batchSigner::countVerifyResult(workerState* worker, size_t index, bool checked, bool matched)
+{
+    if (!checked)
+        worker->failedCount++;
+    else if (matched)
+    {
+        worker->matchedCount++;
+        _verifyResults[index] = VERIFY_MATCH;
+    }
+    else
+    {
+        worker->mismatchCount++;
+        _verifyResults[index] = VERIFY_MISMATCH;
+    }
+}
@@ -0,0 +1,130 @@
+/**************************************************************************
+* File: batchSigner.h
+*
+* This provides the interface for batch signing.
+* One configuration, or one set of routed profiles, is applied to every
+* message in a directory, a list of files matching a wildcard, or a
+* single stream holding many messages separated by a delimiter line.
+* The messages are spread over a signingPool, each thread with its own
+* copy of the profiles, and the algorithm chains and I/O buffers of a
+* thread are reused for every message it signs. Stream output keeps the
+* input order.
+* The same inputs can be verified instead, checking the signature each
+* message carries without writing anything.
+*
+* Author: Hon1nbo
+***************************************************************************/
+
+#ifndef batchSigner_h
+#define batchSigner_h
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <mutex>
+#include "signingRouter.h"
+#include "signingMessage.h"
+#include "mappedFile.h"
+#include "signingPool.h"
+
+using namespace std;
+
+#define BCTT_DEFAULT_DELIMITER "[BCTt:next_message]"
+
+class batchSigner
+{
+    public:
+            batchSigner(signingRouter*);
+            ~batchSigner();
+
+            void setDelimiter(string);
+            string getDelimiter();
+
+            void setThreadCount(unsigned int);
+            unsigned int getThreadCount();
+
+            static bool findInputFiles(string, vector<string>&);
+
+            void signFiles(const vector<string>&, string);
+            void signStream(const char*, size_t, FILE*);
+
+            void verifyFiles(const vector<string>&, FILE*);
+            void verifyStream(const char*, size_t, FILE*);
+
+            size_t getSignedCount();
+            size_t getFailedCount();
+            size_t getMatchedCount();
+            size_t getMismatchCount();
+
+    private:
+            // everything one signing thread needs for itself, all of it
+            // reused for every message that thread signs
+            struct workerState
+            {
+                signingRouter* router;
+                mappedFile inputFile;
+                signingMessage message;
+                string signedMessage;
+                size_t signedCount;
+                size_t failedCount;
+                size_t matchedCount;
+                size_t mismatchCount;
+            };
+
+            // one message of a stream, and the delimiter line after it
+            struct streamMessage
+            {
+                size_t offset;
+                size_t length;
+                size_t delimiterLength;
+            };
+
+            // a signed stream message waiting for the ones before it
+            struct streamResult
+            {
+                string signedMessage;
+                bool signedOk;
+                bool done;
+            };
+
+            void startWorkers(unsigned int);
+            void stopWorkers();
+
+            static void signFileTask(void*, unsigned int, size_t);
+            static void signStreamTask(void*, unsigned int, size_t);
+            void writeStreamResult(size_t, bool, string&);
+            void writeStreamMessage(size_t, bool, const string&);
+            void splitStream(const char*, size_t);
+
+            // how each message of a verify run turned out
+            enum verifyResult { VERIFY_FAILED, VERIFY_MATCH, VERIFY_MISMATCH };
+
+            static void verifyFileTask(void*, unsigned int, size_t);
+            static void verifyStreamTask(void*, unsigned int, size_t);
+            void countVerifyResult(workerState*, size_t, bool, bool);
+
+            signingRouter* _router;
+            string _delimiter;
+            unsigned int _threadCount;
+
+            vector<workerState*> _workers;
+
+            const vector<string>* _inputFiles;
+            vector<string> _outputPaths;
+
+            const char* _streamData;
+            FILE* _streamOutput;
+            vector<streamMessage> _streamMessages;
+            vector<streamResult> _streamResults;
+            size_t _nextStreamResult;
+            mutex _streamLock;
+
+            vector<unsigned char> _verifyResults;
+
+            size_t _signedCount;
+            size_t _failedCount;
+            size_t _matchedCount;
+            size_t _mismatchCount;
+};
+
+#endif
@@ -0,0 +1,368 @@
+/**************************************************************************
+* File: bcttBench.cpp
+*
+* This is the end-to-end benchmark for BCTt, built as its own program,
+* bctt-bench, from this file and every source in src except BCTt.cpp.
+* It generates synthetic HTTP messages with a set number of headers and
+* body size, and runs them through the whole signatureConfig pipeline
+* (indexing, parameter extraction, the algorithm chain, encoding and
+* building the re-signed message) for every supported algorithm.
+* For each algorithm and body size it reports messages/s, MB/s and the
+* p50/p99 latency of one message.
+*
+* Unlike the Crypto++ benchmarks, which time the bare primitives, this
+* times what a user of BCTt waits for, so pipeline changes can be
+* compared against each other.
+*
+* Author: Hon1nbo
+***************************************************************************/
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "signatureConfig.h"
+#include "signatureAlgorithm.h"
+#include "signingMessage.h"
+#include "signingStats.h"
+#include "cryptopp/hrtimer.h"
+
+using namespace std;
+
+#define BENCH_CONFIG_FILE "bcttBench.config.txt"
+#define BENCH_MAC_KEY "bcttBenchKey"
+
+struct benchResult
+{
+    size_t messageCount;
+    double seconds;
+    double p50;             // microseconds
+    double p99;
+};
+
+bool parseSize(string, size_t&);
+bool parseList(string, vector<string>&);
+void buildMessage(size_t, size_t, string&);
+bool writeConfig(const string&);
+bool runCase(const string&, const string&, double, size_t, benchResult&);
+string formatSize(size_t);
+
+int main(int argc, char* argv[])
+{
+    size_t headerCount = 10;
+    double minimumSeconds = 0.5;
+    size_t minimumMessages = 5;
+    vector<string> algorithms;
+    vector<string> sizeNames;
+
+    signatureAlgorithm::getSupportedAlgorithms(algorithms);
+    parseList("100,1K,10K,100K,1M,10M,100M", sizeNames);
+
+    for (int i = 1; i < argc; i++)
+    {
+        string option = argv[i];
+
+        if (i + 1 >= argc)
+        {
+            cerr << "Usage: bctt-bench [--headers N] [--sizes 100,1K,...,100M] [--algorithms md5,sha256,...]" << endl;
+            cerr << "                  [--seconds S] [--messages N]" << endl;
+            return 1;
+        }
+
+        string value = argv[++i];
+
+        if (option == "--headers")
+            headerCount = (size_t) atoi(value.c_str());
+        else if (option == "--sizes")
+            parseList(value, sizeNames);
+        else if (option == "--algorithms")
+            parseList(value, algorithms);
+        else if (option == "--seconds")
+            minimumSeconds = atof(value.c_str());
+        else if (option == "--messages")
+            minimumMessages = (size_t) atoi(value.c_str());
+        else
+        {
+            cerr << "Unknown option " << option << endl;
+            return 1;
+        }
+    }
+
+    vector<size_t> bodySizes;
+
+    for (size_t i = 0; i < sizeNames.size(); i++)
+    {
+        size_t bodySize = 0;
+
+        if (!parseSize(sizeNames[i], bodySize))
+        {
+            cerr << "Bad body size " << sizeNames[i] << endl;
+            return 1;
+        }
+
+        bodySizes.push_back(bodySize);
+    }
+
+    if (minimumMessages == 0)
+        minimumMessages = 1;
+
+    // some registered combinations, such as HMAC over MD2, can not be keyed
+    for (size_t i = 0; i < algorithms.size(); )
+    {
+        string algorithmLine = algorithms[i];
+        if (algorithmLine.compare(0, 5, "hmac<") == 0)
+            algorithmLine += "*" BENCH_MAC_KEY;
+
+        signatureAlgorithm algorithm(algorithmLine);
+
+        if (algorithm.isSupported())
+            i++;
+        else
+        {
+            cerr << "Skipping " << algorithms[i] << ", which is not supported" << endl;
+            algorithms.erase(algorithms.begin() + i);
+        }
+    }
+
+    // the signatures printed for every message would swamp the timings
+    signingStats::setQuiet(true);
+
+    printf("%u headers, at least %u messages and %.2f s per case\n\n", (unsigned int) headerCount, (unsigned int) minimumMessages, minimumSeconds);
+    printf("%-14s %10s %10s %12s %10s %12s %12s\n", "algorithm", "body", "messages", "messages/s", "MB/s", "p50 us", "p99 us");
+
+    int result = 0;
+
+    for (size_t i = 0; i < bodySizes.size(); i++)
+    {
+        string message;
+        buildMessage(headerCount, bodySizes[i], message);
+
+        for (size_t j = 0; j < algorithms.size(); j++)
+        {
+            benchResult bench;
+
+            if (!runCase(algorithms[j], message, minimumSeconds, minimumMessages, bench))
+            {
+                cerr << "Could not benchmark " << algorithms[j] << endl;
+                result = 1;
+                continue;
+            }
+
+            printf("%-14s %10s %10lu %12.1f %10.2f %12.1f %12.1f\n", algorithms[j].c_str(), formatSize(bodySizes[i]).c_str(),
+                    (unsigned long) bench.messageCount, bench.messageCount / bench.seconds,
+                    (double) message.length() * bench.messageCount / bench.seconds / 1000000.0, bench.p50, bench.p99);
+            fflush(stdout);
+        }
+    }
+
+    remove(BENCH_CONFIG_FILE);
+    remove(BENCH_CONFIG_FILE ".BCTt.cache");
+
+    return result;
+}
+
+/**********************************************************************
+ * runCase signs the message with one algorithm until both the minimum
+ * time and the minimum number of messages have been reached.
+ * It returns false if the configuration could not be loaded or a
+ * message could not be signed.
+ *********************************************************************/
+
+bool runCase(const string& algorithm, const string& message, double minimumSeconds, size_t minimumMessages, benchResult& bench)
+{
+    if (!writeConfig(algorithm))
+        return false;
+
+    signatureConfig signer((char*) BENCH_CONFIG_FILE);
+    signer.parseConfigFile();
+
+    if (signer.getError())
+        return false;
+
+    CryptoPP::Timer timer;
+    double ticksPerMicrosecond = (double) timer.TicksPerSecond() / 1000000.0;
+    vector<double> latencies;
+    string signedMessage;
+    double elapsed = 0;
+
+    while (latencies.size() < minimumMessages || elapsed < minimumSeconds * 1000000.0)
+    {
+        CryptoPP::TimerWord start = timer.GetCurrentTimerValue();
+
+        signingMessage tamperedMessage(message.data(), message.length());
+        bool signedOk = signer.signMessage(tamperedMessage, signedMessage);
+
+        double latency = (double) (timer.GetCurrentTimerValue() - start) / ticksPerMicrosecond;
+
+        if (!signedOk)
+            return false;
+
+        latencies.push_back(latency);
+        elapsed += latency;
+    }
+
+    sort(latencies.begin(), latencies.end());
+
+    bench.messageCount = latencies.size();
+    bench.seconds = elapsed / 1000000.0;
+    // nearest rank, so p99 of a few slow messages is the slowest
+    bench.p50 = latencies[(latencies.size() * 50 + 99) / 100 - 1];
+    bench.p99 = latencies[(latencies.size() * 99 + 99) / 100 - 1];
+
+    // a clock too coarse for one message still needs a sensible rate
+    if (bench.seconds <= 0)
+        bench.seconds = 1.0 / 1000000.0;
+
+    return true;
+}
+
+/*************************************************************************
+ * buildMessage makes a request with headerCount filler headers around
+ * the ones the configuration signs, and a body of bodySize bytes
+ ************************************************************************/
+
+void buildMessage(size_t headerCount, size_t bodySize, string& message)
+{
+    char line[128];
+
+    message = "POST /bench/messages HTTP/1.1\r\n";
+    message += "Host: bench.example.com\r\n";
+    message += "X-App-UserId: Merlin\r\n";
+
+    for (size_t i = 0; i < headerCount; i++)
+    {
+        sprintf(line, "X-Bench-Header-%u: filler value %u\r\n", (unsigned int) i, (unsigned int) i);
+        message += line;
+    }
+
+    message += "X-Message-Timestamp: 10:53:26\r\n";
+    message += "X-Message-Signature: 0000000000000000000000000000000000000000000000000000000000000000\r\n";
+
+    sprintf(line, "Content-Length: %lu\r\n\r\n", (unsigned long) bodySize);
+    message += line;
+
+    // printable filler, so no algorithm gets an unusually easy input
+    size_t bodyStart = message.length();
+    message.resize(bodyStart + bodySize);
+
+    unsigned int state = 12345;
+
+    for (size_t i = 0; i < bodySize; i++)
+    {
+        state = state * 1103515245 + 12345;
+        message[bodyStart + i] = (char) (' ' + ((state >> 16) % 95));
+    }
+}
+
+/************************************************************************
+ * writeConfig writes the configuration used for one algorithm, laid out
+ * like the example configuration, with the body signed after a key.
+ * MACs are given a key of their own.
+ * It returns false if the file could not be written.
+ ***********************************************************************/
+
+bool writeConfig(const string& algorithm)
+{
+    FILE* configFile = fopen(BENCH_CONFIG_FILE, "wb");
+
+    if (configFile == NULL)
+    {
+        cerr << "Could not write " << BENCH_CONFIG_FILE << endl;
+        return false;
+    }
+
+    string algorithmLine = algorithm;
+    if (algorithm.compare(0, 5, "hmac<") == 0)
+        algorithmLine += "*" BENCH_MAC_KEY;
+
+    fprintf(configFile, "algorithm:%s:hex\r\n", algorithmLine.c_str());
+    fprintf(configFile, "signatureParameter:X-Message-Signature: \r\n");
+    fprintf(configFile, "parseParameter:X-App-UserId: \r\n");
+    fprintf(configFile, "parseParameter:X-Message-Timestamp: \r\n");
+    fprintf(configFile, "parseParameter:[BCTt:message_body]\r\n");
+    fprintf(configFile, "postParseParameter:macKey:XXXXXX\r\n");
+    fprintf(configFile, "doFinalString:parseParameter-01.parseParameter-00.postParseParameter-00.parseParameter-02.\r\n");
+
+    bool written = (ferror(configFile) == 0);
+
+    if (fclose(configFile) != 0)
+        written = false;
+
+    // the compiled cache of the last algorithm may have the same time stamp
+    remove(BENCH_CONFIG_FILE ".BCTt.cache");
+
+    return written;
+}
+
+/*************************************************************
+ * parseSize reads a size such as 100, 4K or 100M.
+ * It returns false if the size can not be read.
+ ************************************************************/
+
+bool parseSize(string text, size_t& size)
+{
+    char* end = NULL;
+    double value = strtod(text.c_str(), &end);
+
+    if (end == text.c_str() || value < 0)
+        return false;
+
+    string suffix = end;
+
+    if (suffix == "K" || suffix == "k")
+        value *= 1024;
+    else if (suffix == "M" || suffix == "m")
+        value *= 1024 * 1024;
+    else if (suffix != "" && suffix != "B" && suffix != "b")
+        return false;
+
+    size = (size_t) value;
+
+    return true;
+}
+
+/*************************************************************
+ * parseList splits a comma separated list
+ * It returns false if the list is empty.
+ ************************************************************/
+
+bool parseList(string text, vector<string>& items)
+{
+    items.clear();
+
+    size_t start = 0;
+
+    while (start <= text.length())
+    {
+        size_t end = text.find(',', start);
+        if (end == string::npos)
+            end = text.length();
+
+        if (end > start)
+            items.push_back(text.substr(start, end - start));
+
+        start = end + 1;
+    }
+
+    return !items.empty();
+}
+
+/*************************************************************
+ * formatSize prints a body size the way --sizes takes it
+ ************************************************************/
+
+string formatSize(size_t size)
+{
+    char text[32];
+
+    if (size >= 1024 * 1024 && size % (1024 * 1024) == 0)
+        sprintf(text, "%luM", (unsigned long) (size / (1024 * 1024)));
+    else if (size >= 1024 && size % 1024 == 0)
+        sprintf(text, "%luK", (unsigned long) (size / 1024));
+    else
+        sprintf(text, "%lu", (unsigned long) size);
+
+    return text;
+}
@@ -0,0 +1,257 @@
+/**************************************************************************
+* File: computedParameter.cpp
+*
+* This provides the implementation for parameters computed for every
+* message.
+*
+* Author: Hon1nbo
+***************************************************************************/
+
+#include "computedParameter.h"
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+
+#ifdef _WIN32
+        #include "windows.h"
+#endif
+
+using namespace std;
+
+static const char COMPUTED_PREFIX[] = "[BCTt:";
+
+// nonces are cut from a buffer this big, so the pool runs once per
+// few hundred messages
+static const size_t RANDOM_BUFFER_SIZE = 4096;
+
+computedParameter::computedParameter()
+{
+    _type = COMPUTED_TIME;
+    _utc = false;
+    _lastTick = -1;
+    _nonceSize = 0;
+    _random = NULL;
+    _randomUsed = 0;
+}
+
+/******************************************************************
+ * the copy constructor shares the counter, so every thread signing
+ * with a copy of the configuration hands out its own numbers, and
+ * seeds a generator of its own for nonces
+ *****************************************************************/
+
+computedParameter::computedParameter(const computedParameter& other)
+{
+    _random = NULL;
+    _specification = other._specification;
+    _type = other._type;
+    _format = other._format;
+    _utc = other._utc;
+    _lastTick = -1;
+    _counter = other._counter;
+    _nonceSize = other._nonceSize;
+    _randomUsed = 0;
+
+    if (_type == COMPUTED_NONCE)
+    {
+        _random = new CryptoPP::AutoSeededRandomPool();
+        _randomBuffer.New(RANDOM_BUFFER_SIZE);
+        _randomUsed = RANDOM_BUFFER_SIZE;
+    }
+}
+
+computedParameter::~computedParameter()
+{
+    delete _random;
+}
+
+/******************************************************************
+ * isComputed returns true if a parameter value asks for a computed
+ * value rather than giving one
+ *****************************************************************/
+
+bool computedParameter::isComputed(const string& value)
+{
+    return (value.compare(0, sizeof(COMPUTED_PREFIX) - 1, COMPUTED_PREFIX) == 0 && value[value.length() - 1] == ']');
+}
+
+/*************************************************************************
+ * setSpecification sets what to compute from a value such as
+ * [BCTt:time:%H:%M:%S].
+ * It returns false if the kind of value or its argument is not known.
+ ************************************************************************/
+
+bool computedParameter::setSpecification(string specification)
+{
+    if (!isComputed(specification))
+        return false;
+
+    _specification = specification;
+
+    string inner = specification.substr(sizeof(COMPUTED_PREFIX) - 1, specification.length() - sizeof(COMPUTED_PREFIX));
+    size_t found = inner.find(':');
+    string type = inner.substr(0, found);
+    string argument = (found == string::npos) ? "" : inner.substr(found + 1);
+
+    delete _random;
+    _random = NULL;
+    _lastTick = -1;
+
+    if (type == "time" || type == "utctime")
+    {
+        _type = COMPUTED_TIME;
+        _utc = (type == "utctime");
+        _format = (argument == "") ? "unix" : argument;
+        return true;
+    }
+
+    if (type == "counter")
+    {
+        char* end = NULL;
+        unsigned long long start = (argument == "") ? 1 : strtoull(argument.c_str(), &end, 10);
+
+        if (end != NULL && *end != '\0')
+            return false;
+
+        _type = COMPUTED_COUNTER;
+        _counter = make_shared< atomic<unsigned long long> >(start);
+        return true;
+    }
+
+    if (type == "nonce")
+    {
+        int nonceSize = (argument == "") ? 16 : atoi(argument.c_str());
+
+        if (nonceSize <= 0 || nonceSize > (int) RANDOM_BUFFER_SIZE)
+            return false;
+
+        _type = COMPUTED_NONCE;
+        _nonceSize = (size_t) nonceSize;
+
+        try
+        {
+            _random = new CryptoPP::AutoSeededRandomPool();
+        }
+        catch(const CryptoPP::Exception& e)
+        {
+            cerr << e.what() << endl;
+            _random = NULL;
+            return false;
+        }
+
+        _randomBuffer.New(RANDOM_BUFFER_SIZE);
+        _randomUsed = RANDOM_BUFFER_SIZE;
+        return true;
+    }
+
+    return false;
+}
+
+/***************************************************************
+ * next computes the value for the next message. The string is
+ * reused, so it is only good until next is called again.
+ **************************************************************/
+
+const string& computedParameter::next()
+{
+    if (_type == COMPUTED_TIME)
+        nextTime();
+    else if (_type == COMPUTED_COUNTER)
+    {
+        char text[32];
+        sprintf(text, "%llu", (unsigned long long) (*_counter)++);
+        _value = text;
+    }
+    else
+        nextNonce();
+
+    return _value;
+}
+
+/*************************************************************************
+ * nextTime reads the clock and formats it again only if it has moved on
+ * by a whole unit of the format, so a batch formats the time once per
+ * second however many messages it signs
+ ************************************************************************/
+
+void computedParameter::nextTime()
+{
+    long long milliseconds = 0;
+
+#ifdef _WIN32
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+
+    // 100 ns units since 1601
+    long long ticks = ((long long) now.dwHighDateTime << 32) | now.dwLowDateTime;
+    milliseconds = (ticks - 116444736000000000LL) / 10000;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    milliseconds = (long long) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+#endif
+
+    bool perMillisecond = (_format == "unixms");
+    long long tick = perMillisecond ? milliseconds : (milliseconds / 1000);
+
+    if (tick == _lastTick)
+        return;
+
+    _lastTick = tick;
+
+    char text[256];
+
+    if (_format == "unix" || perMillisecond)
+    {
+        sprintf(text, "%lld", tick);
+        _value = text;
+        return;
+    }
+
+    time_t seconds = (time_t) tick;
+    struct tm parts;
+
+#ifdef _WIN32
+    if (_utc)
+        gmtime_s(&parts, &seconds);
+    else
+        localtime_s(&parts, &seconds);
+#else
+    if (_utc)
+        gmtime_r(&seconds, &parts);
+    else
+        localtime_r(&seconds, &parts);
+#endif
+
+    size_t length = strftime(text, sizeof(text), _format.c_str(), &parts);
+    _value.assign(text, length);
+}
+
+/*************************************************************************
+ * nextNonce hex encodes the next bytes of the random buffer, filling it
+ * again from the pool when it runs out
+ ************************************************************************/
+
+void computedParameter::nextNonce()
+{
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+
+    if (_randomUsed + _nonceSize > _randomBuffer.size())
+    {
+        _random->GenerateBlock(_randomBuffer, _randomBuffer.size());
+        _randomUsed = 0;
+    }
+
+    _value.resize(_nonceSize * 2);
+
+    for (size_t i = 0; i < _nonceSize; i++)
+    {
+        byte b = _randomBuffer[_randomUsed + i];
+        _value[i * 2] = HEX_DIGITS[b >> 4];
+        _value[i * 2 + 1] = HEX_DIGITS[b & 0x0f];
+    }
+
+    _randomUsed += _nonceSize;
+}
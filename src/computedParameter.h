@@ -0,0 +1,74 @@
+/**************************************************************************
+* File: computedParameter.h
+*
+* This provides the interface for parameters BCTt makes up for itself on
+* every message, such as a fresh timestamp, counter or nonce, so replay
+* checks on the target do not have to be beaten by hand.
+* A postParseParameter whose value is one of
+*
+*   [BCTt:time:FORMAT]      local time, FORMAT being unix, unixms or
+*                           an strftime format
+*   [BCTt:utctime:FORMAT]   the same in UTC
+*   [BCTt:counter:START]    a counter starting at START (1 by default)
+*   [BCTt:nonce:BYTES]      BYTES random bytes in hex (16 by default)
+*
+* is computed again for every message. Values are made without a system
+* call per message: the clock is read through the C library, which on
+* Linux does not enter the kernel, and is only formatted again when it
+* has moved on, and nonces are cut from a buffer filled by a seeded
+* Crypto++ RandomPool.
+*
+* Author: Hon1nbo
+***************************************************************************/
+
+#ifndef computedParameter_h
+#define computedParameter_h
+
+#include <string>
+#include <atomic>
+#include <memory>
+#include "cryptopp/osrng.h"
+#include "cryptopp/secblock.h"
+
+using namespace std;
+
+class computedParameter
+{
+    public:
+            computedParameter();
+            computedParameter(const computedParameter&);
+            ~computedParameter();
+
+            static bool isComputed(const string&);
+            bool setSpecification(string);
+
+            const string& next();
+
+    private:
+            computedParameter& operator=(const computedParameter&);
+
+            enum computedType { COMPUTED_TIME, COMPUTED_COUNTER, COMPUTED_NONCE };
+
+            void nextTime();
+            void nextNonce();
+
+            string _specification;
+            computedType _type;
+            string _value;              // reused for every message
+
+            // time
+            string _format;             // strftime format, or "unix" / "unixms"
+            bool _utc;
+            long long _lastTick;        // the second, or millisecond, _value shows
+
+            // counter, shared by every copy so threads never repeat a value
+            shared_ptr< atomic<unsigned long long> > _counter;
+
+            // nonce, each copy has its own generator
+            size_t _nonceSize;
+            CryptoPP::AutoSeededRandomPool* _random;
+            CryptoPP::SecByteBlock _randomBuffer;
+            size_t _randomUsed;
+};
+
+#endif
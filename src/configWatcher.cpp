@@ -0,0 +1,365 @@
+/**************************************************************************
+* File: configWatcher.cpp
+*
+* This provides the implementation for reloading a configuration file
+* while BCTt keeps running.
+* The directories holding the files are watched rather than the files
+* themselves, since most editors save by writing a new file and renaming
+* it over the old one. After every reload the watches are set up again,
+* since a changed routes file may name other profiles. The watch thread
+* wakes up twice a second to see if it should stop.
+*
+* Author: Hon1nbo
+***************************************************************************/
+
+#include "configWatcher.h"
+#include "mappedFile.h"
+#include <iostream>
+
+#ifdef _WIN32
+        #include "windows.h"
+#else
+        #include <sys/inotify.h>
+        #include <poll.h>
+        #include <unistd.h>
+#endif
+
+using namespace std;
+
+static const int WATCH_TIMEOUT_MS = 500;
+
+configWatcher::configWatcher(string configFilePath)
+{
+    _configFilePath = configFilePath;
+    _watching = false;
+}
+
+configWatcher::~configWatcher()
+{
+    stop();
+}
+
+/*********************************************************************
+ * load parses the configuration file for the first time.
+ * It returns false if the file could not be parsed.
+ ********************************************************************/
+
+bool configWatcher::load()
+{
+    _watchedFiles.clear();
+
+    shared_ptr<signingRouter> config(new signingRouter());
+
+    if (!config->load(_configFilePath))
+        return false;
+
+    setWatchedFiles(*config);
+    atomic_store(&_config, config);
+
+    return true;
+}
+
+/**********************************************************************
+ * getConfig returns the configuration in use right now. The caller's
+ * reference keeps it alive even if a reload swaps in a new one.
+ *********************************************************************/
+
+shared_ptr<signingRouter> configWatcher::getConfig()
+{
+    return atomic_load(&_config);
+}
+
+/*******************************************************
+ * start begins watching the configuration file.
+ * It returns false if it is already being watched.
+ ******************************************************/
+
+bool configWatcher::start()
+{
+    if (_watching)
+        return false;
+
+    _watching = true;
+    _watchThread = thread(&configWatcher::watch, this);
+
+    return true;
+}
+
+/******************************************************************
+ * stop ends the watch, waiting for a reload in progress to finish
+ *****************************************************************/
+
+void configWatcher::stop()
+{
+    _watching = false;
+
+    if (_watchThread.joinable())
+        _watchThread.join();
+}
+
+/*************************************************************************
+ * setWatchedFiles watches the configuration file and every profile file
+ * the router names. A file that was watched already keeps the status it
+ * had before the reload, so a change made while it was being parsed is
+ * still noticed. Any other file's status is taken now.
+ ************************************************************************/
+
+void configWatcher::setWatchedFiles(signingRouter& config)
+{
+    vector<string> filePaths(1, _configFilePath);
+    const vector<string>& profilePaths = config.getProfilePaths();
+
+    for (size_t i = 0; i < profilePaths.size(); i++)
+        if (profilePaths[i] != _configFilePath)
+            filePaths.push_back(profilePaths[i]);
+
+    vector<watchedFile> watchedFiles;
+
+    for (size_t i = 0; i < filePaths.size(); i++)
+    {
+        watchedFile file;
+        file.filePath = filePaths[i];
+        file.time = 0;
+        file.size = 0;
+
+#ifdef _WIN32
+        size_t found = file.filePath.find_last_of("/\\");
+#else
+        size_t found = file.filePath.find_last_of('/');
+#endif
+
+        if (found == string::npos)
+        {
+            file.directory = ".";
+            file.fileName = file.filePath;
+        }
+        else
+        {
+            file.directory = file.filePath.substr(0, (found == 0) ? 1 : found);
+            file.fileName = file.filePath.substr(found + 1);
+        }
+
+        size_t known = 0;
+
+        while (known < _watchedFiles.size() && _watchedFiles[known].filePath != file.filePath)
+            known++;
+
+        if (known < _watchedFiles.size())
+        {
+            file.time = _watchedFiles[known].time;
+            file.size = _watchedFiles[known].size;
+        }
+        else
+            mappedFile::getFileStatus(file.filePath.c_str(), file.time, file.size);
+
+        watchedFiles.push_back(file);
+    }
+
+    _watchedFiles.swap(watchedFiles);
+}
+
+/******************************************************************
+ * hasChanged returns true if any watched file has a new
+ * modification time or size since it was last loaded
+ *****************************************************************/
+
+bool configWatcher::hasChanged()
+{
+    for (size_t i = 0; i < _watchedFiles.size(); i++)
+    {
+        long long fileTime = 0;
+        long long fileSize = 0;
+
+        if (!mappedFile::getFileStatus(_watchedFiles[i].filePath.c_str(), fileTime, fileSize))
+            continue;
+
+        if (fileTime != _watchedFiles[i].time || fileSize != _watchedFiles[i].size)
+            return true;
+    }
+
+    return false;
+}
+
+/***********************************************************
+ * isWatched returns true if a file with this name, in any
+ * of the watched directories, is one of the watched files
+ **********************************************************/
+
+bool configWatcher::isWatched(const char* fileName)
+{
+    for (size_t i = 0; i < _watchedFiles.size(); i++)
+        if (_watchedFiles[i].fileName == fileName)
+            return true;
+
+    return false;
+}
+
+/*************************************************************************
+ * reload parses the changed files into a new configuration, on the watch
+ * thread, and swaps it in only if it is complete. Either way, the files
+ * it names are watched from then on, so a profile that failed to load
+ * is tried again once it is fixed.
+ ************************************************************************/
+
+void configWatcher::reload()
+{
+    for (size_t i = 0; i < _watchedFiles.size(); i++)
+        mappedFile::getFileStatus(_watchedFiles[i].filePath.c_str(), _watchedFiles[i].time, _watchedFiles[i].size);
+
+    shared_ptr<signingRouter> config(new signingRouter());
+    bool loaded = config->load(_configFilePath);
+
+    setWatchedFiles(*config);
+
+    if (!loaded)
+    {
+        cerr << "Could not reload " << _configFilePath << ", keeping the old configuration." << endl;
+        return;
+    }
+
+    atomic_store(&_config, config);
+
+    if (!signingStats::isQuiet())
+        cout << "Reloaded " << _configFilePath << endl;
+}
+
+#ifdef _WIN32
+
+/*********************************************************************
+ * watch waits for changes in the directories of the watched files
+ * and reloads the configuration when one of the files has changed
+ ********************************************************************/
+
+void configWatcher::watch()
+{
+    while (_watching)
+    {
+        vector<string> directories;
+        vector<HANDLE> changes;
+
+        for (size_t i = 0; i < _watchedFiles.size() && changes.size() < MAXIMUM_WAIT_OBJECTS; i++)
+        {
+            size_t known = 0;
+
+            while (known < directories.size() && directories[known] != _watchedFiles[i].directory)
+                known++;
+
+            if (known < directories.size())
+                continue;
+
+            HANDLE change = FindFirstChangeNotificationA(_watchedFiles[i].directory.c_str(), FALSE,
+                    FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE);
+
+            if (change == INVALID_HANDLE_VALUE)
+            {
+                cerr << "Could not watch " << _watchedFiles[i].filePath << " for changes!" << endl;
+                continue;
+            }
+
+            directories.push_back(_watchedFiles[i].directory);
+            changes.push_back(change);
+        }
+
+        if (changes.empty())
+            return;
+
+        bool reloaded = false;
+
+        while (_watching && !reloaded)
+        {
+            DWORD signalled = WaitForMultipleObjects((DWORD) changes.size(), &changes[0], FALSE, WATCH_TIMEOUT_MS);
+
+            if (signalled < WAIT_OBJECT_0 || signalled >= WAIT_OBJECT_0 + changes.size())
+                continue;
+
+            if (hasChanged())
+            {
+                reload();
+                reloaded = true;
+            }
+            else if (!FindNextChangeNotification(changes[signalled - WAIT_OBJECT_0]))
+                break;
+        }
+
+        for (size_t i = 0; i < changes.size(); i++)
+            FindCloseChangeNotification(changes[i]);
+
+        if (!reloaded)
+            break;
+    }
+}
+
+#else
+
+/*********************************************************************
+ * watch waits for files in the directories of the watched files to
+ * be written or renamed into place, and reloads the configuration
+ * when it is one of them. The watches are set up again after every
+ * reload, for whatever files the new configuration names.
+ ********************************************************************/
+
+void configWatcher::watch()
+{
+    // room for a good number of events, aligned for inotify_event
+    union
+    {
+        struct inotify_event event;
+        char bytes[4096];
+    } buffer;
+
+    while (_watching)
+    {
+        int notify = inotify_init();
+
+        if (notify < 0)
+        {
+            cerr << "Could not watch " << _configFilePath << " for changes!" << endl;
+            return;
+        }
+
+        // a directory watched twice just gets the same watch back
+        for (size_t i = 0; i < _watchedFiles.size(); i++)
+            if (inotify_add_watch(notify, _watchedFiles[i].directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+                cerr << "Could not watch " << _watchedFiles[i].filePath << " for changes!" << endl;
+
+        // anything saved before the watches were in place
+        bool reloaded = hasChanged();
+
+        if (reloaded)
+            reload();
+
+        while (_watching && !reloaded)
+        {
+            struct pollfd waiting;
+            waiting.fd = notify;
+            waiting.events = POLLIN;
+            waiting.revents = 0;
+
+            if (poll(&waiting, 1, WATCH_TIMEOUT_MS) <= 0)
+                continue;
+
+            ssize_t bytesRead = read(notify, buffer.bytes, sizeof(buffer.bytes));
+            bool touched = false;
+
+            for (ssize_t offset = 0; offset < bytesRead; )
+            {
+                const struct inotify_event* event = (const struct inotify_event*) (buffer.bytes + offset);
+
+                if (event->len > 0 && isWatched(event->name))
+                    touched = true;
+
+                offset += sizeof(struct inotify_event) + event->len;
+            }
+
+            if (touched && hasChanged())
+            {
+                reload();
+                reloaded = true;
+            }
+        }
+
+        close(notify);
+    }
+}
+
+#endif
@@ -0,0 +1,72 @@
+/**************************************************************************
+* File: configWatcher.h
+*
+* This provides the interface for reloading a configuration file while
+* BCTt keeps running.
+* The current configuration, or set of routed profiles, is held through
+* a shared pointer. A thread watches the file and, for a routes file,
+* each profile file it names (inotify on Linux, change notifications on
+* Windows). When any of them changes, the file is loaded into a new
+* signingRouter and the pointer is swapped atomically. The watches then
+* follow the files the new configuration names. A signature already
+* being made keeps its own reference and finishes on the old
+* configuration, and getConfig never waits on a reparse. A file that no
+* longer parses is reported and the old configuration stays in use.
+*
+* Author: Hon1nbo
+***************************************************************************/
+
+#ifndef configWatcher_h
+#define configWatcher_h
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include "signingRouter.h"
+
+using namespace std;
+
+class configWatcher
+{
+    public:
+            configWatcher(string);
+            ~configWatcher();
+
+            bool load();
+            shared_ptr<signingRouter> getConfig();
+
+            bool start();
+            void stop();
+
+    private:
+            configWatcher(const configWatcher&);
+            configWatcher& operator=(const configWatcher&);
+
+            // a file the configuration was loaded from, as it was then
+            struct watchedFile
+            {
+                string filePath;
+                string directory;
+                string fileName;
+                long long time;
+                long long size;
+            };
+
+            void watch();
+            bool hasChanged();
+            bool isWatched(const char*);
+            void reload();
+            void setWatchedFiles(signingRouter&);
+
+            string _configFilePath;
+            vector<watchedFile> _watchedFiles;  // only used by one thread at a time
+
+            shared_ptr<signingRouter> _config;   // only through atomic_load/atomic_store
+
+            thread _watchThread;
+            atomic<bool> _watching;
+};
+
+#endif
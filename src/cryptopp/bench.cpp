@@ -9,6 +9,7 @@
 #include "md5.h"
 #include "md5mac.h"
 #include "sha.h"
+#include "cpu.h"
 #include "haval.h"
 #include "tiger.h"
 #include "ripemd.h"
@@ -209,6 +210,28 @@ void BenchMarkKeyless(const char *name, double timeTotal, T *x=NULL)
 	BenchMark(name, c, timeTotal);
 }
 
+#ifdef WORD64_AVAILABLE
+// SHA-512 with its compression function fixed, so the portable kernel and the AVX2 one
+// that SHA512::Transform picks at run time can be timed side by side
+class SHA512Kernels : public SHA512
+{
+public:
+	using SHA512::Transform_CXX;
+#ifdef CRYPTOPP_X86_INTRINSICS_AVAILABLE
+	using SHA512::Transform_AVX2;
+#endif
+};
+
+template <void (CRYPTOPP_API * KERNEL)(word64 *digest, const word64 *data)>
+class SHA512WithKernel : public IteratedHashWithStaticTransform<word64, BigEndian, 128, 64, SHA512WithKernel<KERNEL> >
+{
+public:
+	static void CRYPTOPP_API InitState(word64 *state) {SHA512::InitState(state);}
+	static void CRYPTOPP_API Transform(word64 *digest, const word64 *data) {KERNEL(digest, data);}
+	static const char * CRYPTOPP_API StaticAlgorithmName() {return "SHA-512";}
+};
+#endif
+
 void BenchmarkAll(double t)
 {
 #if 1
@@ -226,6 +249,12 @@ void BenchmarkAll(double t)
 	BenchMarkKeyless<SHA256>("SHA-256", t);
 #ifdef WORD64_AVAILABLE
 	BenchMarkKeyless<SHA512>("SHA-512", t);
+	BenchMarkKeyless<SHA512WithKernel<&SHA512Kernels::Transform_CXX> >("SHA-512 (C++)", t);
+#ifdef CRYPTOPP_X86_INTRINSICS_AVAILABLE
+	if (HasAVX2())
+		BenchMarkKeyless<SHA512WithKernel<&SHA512Kernels::Transform_AVX2> >("SHA-512 (AVX2)", t);
+#endif
+	BenchMarkKeyless<SHA384>("SHA-384", t);
 #endif
 	BenchMarkKeyless<HAVAL3>("HAVAL (pass=3)", t);
 	BenchMarkKeyless<HAVAL4>("HAVAL (pass=4)", t);
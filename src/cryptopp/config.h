@@ -226,6 +226,22 @@ NAMESPACE_END
 #define CRYPTOPP_X86ASM_AVAILABLE
 #endif
 
+// CPUID, and compilers that can build SSSE3, SSE4.1, SHA and AVX2 intrinsics into single functions
+// without those instruction sets being enabled for the whole file
+#if !defined(CRYPTOPP_DISABLE_CPUID) && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)) \
+	&& (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))) || (defined(_MSC_VER) && _MSC_VER >= 1900))
+#define CRYPTOPP_CPUID_AVAILABLE
+#endif
+
+#if defined(CRYPTOPP_CPUID_AVAILABLE) && !defined(CRYPTOPP_DISABLE_X86_INTRINSICS)
+#define CRYPTOPP_X86_INTRINSICS_AVAILABLE
+#if defined(__GNUC__) || defined(__clang__)
+#	define CRYPTOPP_TARGET(x) __attribute__((target(x)))
+#else
+#	define CRYPTOPP_TARGET(x)
+#endif
+#endif
+
 // how to disable inlining
 #if defined(_MSC_VER) && _MSC_VER >= 1300
 #	define CRYPTOPP_NOINLINE_DOTDOTDOT
@@ -0,0 +1,112 @@
+// cpu.cpp - x86 instruction set detection for the hash kernels, placed in the public domain
+
+#include "pch.h"
+#include "cpu.h"
+
+#ifdef CRYPTOPP_CPUID_AVAILABLE
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+NAMESPACE_BEGIN(CryptoPP)
+
+struct X86Features
+{
+	bool hasSSE2, hasSSSE3, hasSSE41, hasSHA, hasAVX2;
+};
+
+static void CpuId(word32 function, word32 subfunction, word32 *output)
+{
+#ifdef _MSC_VER
+	__cpuidex((int *)output, function, subfunction);
+#elif defined(__i386__) && defined(__PIC__)
+	// ebx holds the GOT pointer, so it has to be saved
+	__asm__ __volatile__
+	(
+		"xchgl %%ebx, %1; cpuid; xchgl %%ebx, %1"
+		: "=a" (output[0]), "=&r" (output[1]), "=c" (output[2]), "=d" (output[3])
+		: "a" (function), "c" (subfunction)
+	);
+#else
+	__asm__ __volatile__
+	(
+		"cpuid"
+		: "=a" (output[0]), "=b" (output[1]), "=c" (output[2]), "=d" (output[3])
+		: "a" (function), "c" (subfunction)
+	);
+#endif
+}
+
+// the state the operating system saves on a context switch, bit 1 for XMM and bit 2 for YMM
+static word32 XGetBV0()
+{
+#ifdef _MSC_VER
+	return (word32)_xgetbv(0);
+#else
+	word32 eax, edx;
+	__asm__ __volatile__ (".byte 0x0f, 0x01, 0xd0" : "=a" (eax), "=d" (edx) : "c" (0));
+	return eax;
+#endif
+}
+
+static X86Features DetectX86Features()
+{
+	word32 cpuid[4], cpuid1[4], cpuid7[4] = {0, 0, 0, 0};
+	X86Features features;
+
+	CpuId(0, 0, cpuid);
+	word32 maxFunction = cpuid[0];
+
+	CpuId(1, 0, cpuid1);
+	if (maxFunction >= 7)
+		CpuId(7, 0, cpuid7);
+
+	features.hasSSE2 = (cpuid1[3] & (1 << 26)) != 0;
+	features.hasSSSE3 = (cpuid1[2] & (1 << 9)) != 0;
+	features.hasSSE41 = (cpuid1[2] & (1 << 19)) != 0;
+	features.hasSHA = features.hasSSE41 && (cpuid7[1] & (1 << 29)) != 0;
+
+	bool osxsave = (cpuid1[2] & (1 << 27)) != 0;
+	bool avx = (cpuid1[2] & (1 << 28)) != 0;
+	features.hasAVX2 = osxsave && avx && (XGetBV0() & 6) == 6 && (cpuid7[1] & (1 << 5)) != 0;
+
+	return features;
+}
+
+// the first caller runs the detection, and the initialisation of a function-local static
+// makes any thread asking at the same time wait for it rather than read half-written flags
+static const X86Features & GetX86Features()
+{
+	static const X86Features s_features = DetectX86Features();
+	return s_features;
+}
+
+bool CRYPTOPP_API HasSSE2()
+{
+	return GetX86Features().hasSSE2;
+}
+
+bool CRYPTOPP_API HasSSSE3()
+{
+	return GetX86Features().hasSSSE3;
+}
+
+bool CRYPTOPP_API HasSSE41()
+{
+	return GetX86Features().hasSSE41;
+}
+
+bool CRYPTOPP_API HasSHA()
+{
+	return GetX86Features().hasSHA;
+}
+
+bool CRYPTOPP_API HasAVX2()
+{
+	return GetX86Features().hasAVX2;
+}
+
+NAMESPACE_END
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef CRYPTOPP_CPU_H
+#define CRYPTOPP_CPU_H
+
+#include "config.h"
+
+NAMESPACE_BEGIN(CryptoPP)
+
+#ifdef CRYPTOPP_CPUID_AVAILABLE
+
+// x86 instruction sets the hash kernels can use, looked up with CPUID the first time any is asked for.
+// AVX2 is only reported if the operating system also saves the YMM registers.
+bool CRYPTOPP_API HasSSE2();
+bool CRYPTOPP_API HasSSSE3();
+bool CRYPTOPP_API HasSSE41();
+bool CRYPTOPP_API HasSHA();
+bool CRYPTOPP_API HasAVX2();
+
+#else
+
+inline bool HasSSE2()	{return false;}
+inline bool HasSSSE3()	{return false;}
+inline bool HasSSE41()	{return false;}
+inline bool HasSHA()	{return false;}
+inline bool HasAVX2()	{return false;}
+
+#endif
+
+NAMESPACE_END
+
+#endif
@@ -254,6 +254,10 @@ SOURCE=.\channels.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\cpu.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\crc.cpp
 # End Source File
 # Begin Source File
@@ -403,6 +407,10 @@ SOURCE=.\marss.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\mbhash.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\md2.cpp
 # End Source File
 # Begin Source File
@@ -720,6 +728,10 @@ SOURCE=.\config.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\cpu.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\crc.h
 # End Source File
 # Begin Source File
@@ -872,6 +884,10 @@ SOURCE=.\mars.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\mbhash.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\md2.h
 # End Source File
 # Begin Source File
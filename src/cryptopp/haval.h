@@ -19,6 +19,7 @@ public:
 	HAVAL(unsigned int digestSize=DIGESTSIZE, unsigned int passes=3);
 	void TruncatedFinal(byte *hash, size_t size);
 	unsigned int DigestSize() const {return digestSize;}
+	Clonable * Clone() const {return new HAVAL(*this);}
 
 	static const char * StaticAlgorithmName() {return "HAVAL";}
 	std::string AlgorithmName() const {return std::string("HAVAL(") + IntToString(digestSize) + "," + IntToString(pass) + ")";}
@@ -20,7 +20,7 @@ void HMAC_Base::UncheckedSetKey(const byte *userKey, unsigned int keylength, con
 	if (!blockSize)
 		throw InvalidArgument("HMAC: can only be used with a block-based hash function");
 
-	m_buf.resize(2*AccessHash().BlockSize() + AccessHash().DigestSize());
+	m_buf.resize(2*AccessHash().BlockSize() + AccessHash().DigestSize() + 2*HashMidstateSize());
 
 	if (keylength <= blockSize)
 		memcpy(AccessIpad(), userKey, keylength);
@@ -38,13 +38,54 @@ void HMAC_Base::UncheckedSetKey(const byte *userKey, unsigned int keylength, con
 		AccessOpad()[i] = AccessIpad()[i] ^ 0x5c;
 		AccessIpad()[i] ^= 0x36;
 	}
+
+	m_midstates = HashMidstateSize() != 0;
+	if (m_midstates)
+	{
+		hash.Update(AccessIpad(), blockSize);
+		SaveHashMidstate(AccessInnerMidstate());
+		hash.Restart();
+
+		hash.Update(AccessOpad(), blockSize);
+		SaveHashMidstate(AccessOuterMidstate());
+		hash.Restart();
+	}
+}
+
+void HMAC_Base::GetKeyState(byte *keyState) const
+{
+	HMAC_Base &self = *const_cast<HMAC_Base*>(this);
+
+	if (!m_midstates)
+		throw InvalidArgument("HMAC: no key state, either no key is set or the hash has no midstates");
+
+	memcpy(keyState, self.AccessInnerMidstate(), KeyStateSize());
+}
+
+void HMAC_Base::SetKeyState(const byte *keyState, size_t length)
+{
+	if (length == 0 || length != KeyStateSize())
+		throw InvalidArgument("HMAC: key state is not the right length for " + AlgorithmName());
+
+	Restart();
+
+	HashTransformation &hash = AccessHash();
+
+	// without the key there are no padded keys, only the midstates
+	m_buf.resize(2*hash.BlockSize() + hash.DigestSize() + length);
+	memset(m_buf, 0, 2*hash.BlockSize() + hash.DigestSize());
+	memcpy(AccessInnerMidstate(), keyState, length);
+	m_midstates = true;
 }
 
 void HMAC_Base::KeyInnerHash()
 {
 	assert(!m_innerHashKeyed);
 	HashTransformation &hash = AccessHash();
-	hash.Update(AccessIpad(), hash.BlockSize());
+	if (m_midstates)
+		RestoreHashMidstate(AccessInnerMidstate());
+	else
+		hash.Update(AccessIpad(), hash.BlockSize());
 	m_innerHashKeyed = true;
 }
 
@@ -74,7 +115,10 @@ void HMAC_Base::TruncatedFinal(byte *mac, size_t size)
 		KeyInnerHash();
 	hash.Final(AccessInnerHash());
 
-	hash.Update(AccessOpad(), hash.BlockSize());
+	if (m_midstates)
+		RestoreHashMidstate(AccessOuterMidstate());
+	else
+		hash.Update(AccessOpad(), hash.BlockSize());
 	hash.Update(AccessInnerHash(), hash.DigestSize());
 	hash.TruncatedFinal(mac, size);
 
@@ -5,6 +5,7 @@
 
 #include "seckey.h"
 #include "secblock.h"
+#include "iterhash.h"
 
 NAMESPACE_BEGIN(CryptoPP)
 
@@ -12,7 +13,7 @@ NAMESPACE_BEGIN(CryptoPP)
 class CRYPTOPP_DLL CRYPTOPP_NO_VTABLE HMAC_Base : public VariableKeyLength<16, 0, INT_MAX>, public MessageAuthenticationCode
 {
 public:
-	HMAC_Base() : m_innerHashKeyed(false) {}
+	HMAC_Base() : m_innerHashKeyed(false), m_midstates(false) {}
 	void UncheckedSetKey(const byte *userKey, unsigned int keylength, const NameValuePairs &params);
 
 	void Restart();
@@ -21,23 +22,47 @@ public:
 	unsigned int OptimalBlockSize() const {return const_cast<HMAC_Base*>(this)->AccessHash().OptimalBlockSize();}
 	unsigned int DigestSize() const {return const_cast<HMAC_Base*>(this)->AccessHash().DigestSize();}
 
+	//! size of the key state, the hash midstates after the inner and outer padded keys, or 0 if the hash has no midstates
+	unsigned int KeyStateSize() const {return 2*const_cast<HMAC_Base*>(this)->HashMidstateSize();}
+	//! write the key state, which keys another HMAC with the same hash through SetKeyState
+	void GetKeyState(byte *keyState) const;
+	//! key this HMAC from a saved key state rather than the key itself
+	void SetKeyState(const byte *keyState, size_t length);
+
 protected:
 	virtual HashTransformation & AccessHash() =0;
+	// A hash built on IteratedHashBase can start from a saved midstate. The padded keys are then
+	// hashed once when the key is set, rather than once each for every MAC.
+	virtual unsigned int HashMidstateSize() {return 0;}
+	virtual void SaveHashMidstate(byte *) {}
+	virtual void RestoreHashMidstate(const byte *) {}
+
 	byte * AccessIpad() {return m_buf;}
 	byte * AccessOpad() {return m_buf + AccessHash().BlockSize();}
 	byte * AccessInnerHash() {return m_buf + 2*AccessHash().BlockSize();}
+	byte * AccessInnerMidstate() {return m_buf + 2*AccessHash().BlockSize() + AccessHash().DigestSize();}
+	byte * AccessOuterMidstate() {return AccessInnerMidstate() + HashMidstateSize();}
 
 private:
 	void KeyInnerHash();
 
 	SecByteBlock m_buf;
-	bool m_innerHashKeyed;
+	bool m_innerHashKeyed, m_midstates;
 };
 
+// overload resolution gives HMAC<T> midstates for hashes built on IteratedHashBase, and none for others such as MD2
+template <class T, class B> inline unsigned int HMAC_MidstateSize(IteratedHashBase<T, B> &hash) {return hash.MidstateSize();}
+template <class T, class B> inline void HMAC_SaveMidstate(IteratedHashBase<T, B> &hash, byte *midstate) {hash.SaveMidstate(midstate);}
+template <class T, class B> inline void HMAC_RestoreMidstate(IteratedHashBase<T, B> &hash, const byte *midstate) {hash.RestoreMidstate(midstate, hash.BlockSize());}
+
+inline unsigned int HMAC_MidstateSize(HashTransformation &) {return 0;}
+inline void HMAC_SaveMidstate(HashTransformation &, byte *) {}
+inline void HMAC_RestoreMidstate(HashTransformation &, const byte *) {}
+
 //! <a href="http://www.weidai.com/scan-mirror/mac.html#HMAC">HMAC</a>
 /*! HMAC(K, text) = H(K XOR opad, H(K XOR ipad, text)) */
 template <class T>
-class HMAC : public MessageAuthenticationCodeImpl<HMAC_Base, HMAC<T> >
+class HMAC : public ClonableImpl<HMAC<T>, MessageAuthenticationCodeImpl<HMAC_Base, HMAC<T> > >
 {
 public:
 	CRYPTOPP_CONSTANT(DIGESTSIZE=T::DIGESTSIZE)
@@ -52,6 +77,9 @@ public:
 
 private:
 	HashTransformation & AccessHash() {return m_hash;}
+	unsigned int HashMidstateSize() {return HMAC_MidstateSize(m_hash);}
+	void SaveHashMidstate(byte *midstate) {HMAC_SaveMidstate(m_hash, midstate);}
+	void RestoreHashMidstate(const byte *midstate) {HMAC_RestoreMidstate(m_hash, midstate);}
 
 	T m_hash;
 };
@@ -112,6 +112,65 @@ template <class T, class BASE> void IteratedHashBase<T, BASE>::PadLastBlock(unsi
 	}
 }
 
+template <class T, class BASE> void IteratedHashBase<T, BASE>::SaveMidstate(byte *midstate) const
+{
+	if (ModPowerOf2(m_countLo, BlockSize()) != 0)
+		throw InvalidArgument("IteratedHashBase: a midstate can only be saved after a whole number of blocks");
+
+	ByteOrder order = this->GetByteOrder();
+	for (unsigned int i=0; i<m_digest.size(); i++)
+		PutWord(false, order, midstate + i*sizeof(T), m_digest[i]);
+}
+
+template <class T, class BASE> void IteratedHashBase<T, BASE>::RestoreMidstate(const byte *midstate, lword length)
+{
+	if (ModPowerOf2(length, BlockSize()) != 0)
+		throw InvalidArgument("IteratedHashBase: a midstate can only be restored after a whole number of blocks");
+
+	ByteOrder order = this->GetByteOrder();
+	for (unsigned int i=0; i<m_digest.size(); i++)
+		m_digest[i] = GetWord<T>(false, order, midstate + i*sizeof(T));
+
+	m_countLo = (T)length;
+	m_countHi = (T)SafeRightShift<8*sizeof(T)>(length);
+}
+
+// the state is the chaining state and the count in the hash's byte order, then the partial block padded with zeros
+
+template <class T, class BASE> void IteratedHashBase<T, BASE>::SaveState(byte *state) const
+{
+	ByteOrder order = this->GetByteOrder();
+	unsigned int blockSize = BlockSize();
+	unsigned int num = ModPowerOf2(m_countLo, blockSize);
+
+	for (unsigned int i=0; i<m_digest.size(); i++, state += sizeof(T))
+		PutWord(false, order, state, m_digest[i]);
+
+	PutWord(false, order, state, m_countLo);
+	PutWord(false, order, state + sizeof(T), m_countHi);
+	state += 2*sizeof(T);
+
+	memcpy(state, m_data, num);
+	memset(state + num, 0, blockSize - num);
+}
+
+template <class T, class BASE> void IteratedHashBase<T, BASE>::RestoreState(const byte *state, size_t length)
+{
+	if (length != StateSize())
+		throw InvalidArgument("IteratedHashBase: state is not the right length for " + this->AlgorithmName());
+
+	ByteOrder order = this->GetByteOrder();
+
+	for (unsigned int i=0; i<m_digest.size(); i++, state += sizeof(T))
+		m_digest[i] = GetWord<T>(false, order, state);
+
+	m_countLo = GetWord<T>(false, order, state);
+	m_countHi = GetWord<T>(false, order, state + sizeof(T));
+	state += 2*sizeof(T);
+
+	memcpy(m_data, state, ModPowerOf2(m_countLo, BlockSize()));
+}
+
 template <class T, class BASE> void IteratedHashBase<T, BASE>::Restart()
 {
 	m_countLo = m_countHi = 0;
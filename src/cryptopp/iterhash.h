@@ -32,6 +32,20 @@ public:
 	void Restart();
 	void TruncatedFinal(byte *digest, size_t size);
 
+	//! size of the chaining state, which is all there is to a hash between blocks
+	unsigned int MidstateSize() const {return (unsigned int)m_digest.size() * sizeof(T);}
+	//! write the chaining state in the hash's byte order, only allowed after a whole number of blocks
+	void SaveMidstate(byte *midstate) const;
+	//! carry on from a midstate saved after length bytes, as if those bytes had been hashed again
+	void RestoreMidstate(const byte *midstate, lword length);
+
+	//! size of the state SaveState writes: the chaining state, the count of bytes hashed and a block for any partial block
+	unsigned int StateSize() const {return MidstateSize() + 2*sizeof(T) + BlockSize();}
+	//! checkpoint the hash at any point in the input, so inputs sharing a prefix need only hash it once
+	void SaveState(byte *state) const;
+	//! go back to a checkpoint written by SaveState on a hash of the same type
+	void RestoreState(const byte *state, size_t length);
+
 protected:
 	void SetBlockSize(unsigned int blockSize) {m_data.resize(blockSize / sizeof(HashWordType));}
 	void SetStateSize(unsigned int stateSize) {m_digest.resize(stateSize / sizeof(HashWordType));}
@@ -0,0 +1,322 @@
+// mbhash.cpp - written and placed in the public domain for BCTt
+
+// The lane kernels run the same rounds as SHA256::Transform_CXX and MD5::Transform,
+// with every variable a vector holding one 32-bit word of each message.
+
+#include "pch.h"
+#include "mbhash.h"
+#include "misc.h"
+#include "cpu.h"
+
+#ifdef CRYPTOPP_X86_INTRINSICS_AVAILABLE
+#include <immintrin.h>
+#endif
+
+NAMESPACE_BEGIN(CryptoPP)
+
+#ifdef CRYPTOPP_X86_INTRINSICS_AVAILABLE
+
+// the round constants are protected members of SHA256
+struct SHA256_Constants : public SHA256
+{
+	static const word32 *Table() {return K;}
+};
+
+#define SHA256_LANES_S0(x) V_XOR(V_XOR(V_ROTR(x,2), V_ROTR(x,13)), V_ROTR(x,22))
+#define SHA256_LANES_S1(x) V_XOR(V_XOR(V_ROTR(x,6), V_ROTR(x,11)), V_ROTR(x,25))
+#define SHA256_LANES_s0(x) V_XOR(V_XOR(V_ROTR(x,7), V_ROTR(x,18)), V_SHR(x,3))
+#define SHA256_LANES_s1(x) V_XOR(V_XOR(V_ROTR(x,17), V_ROTR(x,19)), V_SHR(x,10))
+#define SHA256_LANES_CH(x,y,z) V_XOR(z, V_AND(x, V_XOR(y,z)))
+#define SHA256_LANES_MAJ(x,y,z) V_OR(V_AND(x,y), V_AND(z, V_OR(x,y)))
+
+#define SHA256_LANES_SCHEDULE(i) W[(i)&15] = V_ADD(V_ADD(W[(i)&15], SHA256_LANES_s1(W[((i)-2)&15])), V_ADD(W[((i)-7)&15], SHA256_LANES_s0(W[((i)-15)&15])));
+
+#define SHA256_LANES_ROUND(a,b,c,d,e,f,g,h,i) \
+	T1 = V_ADD(V_ADD(V_ADD(h, SHA256_LANES_S1(e)), V_ADD(SHA256_LANES_CH(e,f,g), V_SET1(K[i]))), W[(i)&15]);\
+	d = V_ADD(d, T1);\
+	h = V_ADD(T1, V_ADD(SHA256_LANES_S0(a), SHA256_LANES_MAJ(a,b,c)));
+
+#define SHA256_LANES_EIGHT(j) \
+	SHA256_LANES_ROUND(a,b,c,d,e,f,g,h,j+0) SHA256_LANES_ROUND(h,a,b,c,d,e,f,g,j+1)\
+	SHA256_LANES_ROUND(g,h,a,b,c,d,e,f,j+2) SHA256_LANES_ROUND(f,g,h,a,b,c,d,e,j+3)\
+	SHA256_LANES_ROUND(e,f,g,h,a,b,c,d,j+4) SHA256_LANES_ROUND(d,e,f,g,h,a,b,c,j+5)\
+	SHA256_LANES_ROUND(c,d,e,f,g,h,a,b,j+6) SHA256_LANES_ROUND(b,c,d,e,f,g,h,a,j+7)
+
+#define SHA256_LANES_BODY \
+	const word32 *K = SHA256_Constants::Table();\
+	V_TYPE a = V_LOAD(state+0*V_LANES), b = V_LOAD(state+1*V_LANES), c = V_LOAD(state+2*V_LANES), d = V_LOAD(state+3*V_LANES);\
+	V_TYPE e = V_LOAD(state+4*V_LANES), f = V_LOAD(state+5*V_LANES), g = V_LOAD(state+6*V_LANES), h = V_LOAD(state+7*V_LANES);\
+	V_TYPE W[16], T1;\
+	for (unsigned int i=0; i<16; i++)\
+		W[i] = V_LOAD(data+i*V_LANES);\
+	for (unsigned int j=0; j<64; j+=8)\
+	{\
+		if (j >= 16)\
+			for (unsigned int i=j; i<j+8; i++)\
+				SHA256_LANES_SCHEDULE(i)\
+		SHA256_LANES_EIGHT(j)\
+	}\
+	V_STORE(state+0*V_LANES, V_ADD(a, V_LOAD(state+0*V_LANES))); V_STORE(state+1*V_LANES, V_ADD(b, V_LOAD(state+1*V_LANES)));\
+	V_STORE(state+2*V_LANES, V_ADD(c, V_LOAD(state+2*V_LANES))); V_STORE(state+3*V_LANES, V_ADD(d, V_LOAD(state+3*V_LANES)));\
+	V_STORE(state+4*V_LANES, V_ADD(e, V_LOAD(state+4*V_LANES))); V_STORE(state+5*V_LANES, V_ADD(f, V_LOAD(state+5*V_LANES)));\
+	V_STORE(state+6*V_LANES, V_ADD(g, V_LOAD(state+6*V_LANES))); V_STORE(state+7*V_LANES, V_ADD(h, V_LOAD(state+7*V_LANES)));
+
+#define MD5_LANES_F1(x, y, z) V_XOR(z, V_AND(x, V_XOR(y, z)))
+#define MD5_LANES_F2(x, y, z) MD5_LANES_F1(z, x, y)
+#define MD5_LANES_F3(x, y, z) V_XOR(V_XOR(x, y), z)
+#define MD5_LANES_F4(x, y, z) V_XOR(y, V_OR(x, V_XOR(z, V_SET1(0xffffffff))))
+
+#define MD5_LANES_STEP(f, w, x, y, z, i, k, s) \
+	w = V_ADD(V_ROTL(V_ADD(V_ADD(w, f(x, y, z)), V_ADD(V_LOAD(data+(i)*V_LANES), V_SET1(k))), s), x);
+
+#define MD5_LANES_BODY \
+	V_TYPE a = V_LOAD(state+0*V_LANES), b = V_LOAD(state+1*V_LANES), c = V_LOAD(state+2*V_LANES), d = V_LOAD(state+3*V_LANES);\
+	MD5_LANES_STEP(MD5_LANES_F1, a, b, c, d, 0, 0xd76aa478, 7) MD5_LANES_STEP(MD5_LANES_F1, d, a, b, c, 1, 0xe8c7b756, 12)\
+	MD5_LANES_STEP(MD5_LANES_F1, c, d, a, b, 2, 0x242070db, 17) MD5_LANES_STEP(MD5_LANES_F1, b, c, d, a, 3, 0xc1bdceee, 22)\
+	MD5_LANES_STEP(MD5_LANES_F1, a, b, c, d, 4, 0xf57c0faf, 7) MD5_LANES_STEP(MD5_LANES_F1, d, a, b, c, 5, 0x4787c62a, 12)\
+	MD5_LANES_STEP(MD5_LANES_F1, c, d, a, b, 6, 0xa8304613, 17) MD5_LANES_STEP(MD5_LANES_F1, b, c, d, a, 7, 0xfd469501, 22)\
+	MD5_LANES_STEP(MD5_LANES_F1, a, b, c, d, 8, 0x698098d8, 7) MD5_LANES_STEP(MD5_LANES_F1, d, a, b, c, 9, 0x8b44f7af, 12)\
+	MD5_LANES_STEP(MD5_LANES_F1, c, d, a, b, 10, 0xffff5bb1, 17) MD5_LANES_STEP(MD5_LANES_F1, b, c, d, a, 11, 0x895cd7be, 22)\
+	MD5_LANES_STEP(MD5_LANES_F1, a, b, c, d, 12, 0x6b901122, 7) MD5_LANES_STEP(MD5_LANES_F1, d, a, b, c, 13, 0xfd987193, 12)\
+	MD5_LANES_STEP(MD5_LANES_F1, c, d, a, b, 14, 0xa679438e, 17) MD5_LANES_STEP(MD5_LANES_F1, b, c, d, a, 15, 0x49b40821, 22)\
+	MD5_LANES_STEP(MD5_LANES_F2, a, b, c, d, 1, 0xf61e2562, 5) MD5_LANES_STEP(MD5_LANES_F2, d, a, b, c, 6, 0xc040b340, 9)\
+	MD5_LANES_STEP(MD5_LANES_F2, c, d, a, b, 11, 0x265e5a51, 14) MD5_LANES_STEP(MD5_LANES_F2, b, c, d, a, 0, 0xe9b6c7aa, 20)\
+	MD5_LANES_STEP(MD5_LANES_F2, a, b, c, d, 5, 0xd62f105d, 5) MD5_LANES_STEP(MD5_LANES_F2, d, a, b, c, 10, 0x02441453, 9)\
+	MD5_LANES_STEP(MD5_LANES_F2, c, d, a, b, 15, 0xd8a1e681, 14) MD5_LANES_STEP(MD5_LANES_F2, b, c, d, a, 4, 0xe7d3fbc8, 20)\
+	MD5_LANES_STEP(MD5_LANES_F2, a, b, c, d, 9, 0x21e1cde6, 5) MD5_LANES_STEP(MD5_LANES_F2, d, a, b, c, 14, 0xc33707d6, 9)\
+	MD5_LANES_STEP(MD5_LANES_F2, c, d, a, b, 3, 0xf4d50d87, 14) MD5_LANES_STEP(MD5_LANES_F2, b, c, d, a, 8, 0x455a14ed, 20)\
+	MD5_LANES_STEP(MD5_LANES_F2, a, b, c, d, 13, 0xa9e3e905, 5) MD5_LANES_STEP(MD5_LANES_F2, d, a, b, c, 2, 0xfcefa3f8, 9)\
+	MD5_LANES_STEP(MD5_LANES_F2, c, d, a, b, 7, 0x676f02d9, 14) MD5_LANES_STEP(MD5_LANES_F2, b, c, d, a, 12, 0x8d2a4c8a, 20)\
+	MD5_LANES_STEP(MD5_LANES_F3, a, b, c, d, 5, 0xfffa3942, 4) MD5_LANES_STEP(MD5_LANES_F3, d, a, b, c, 8, 0x8771f681, 11)\
+	MD5_LANES_STEP(MD5_LANES_F3, c, d, a, b, 11, 0x6d9d6122, 16) MD5_LANES_STEP(MD5_LANES_F3, b, c, d, a, 14, 0xfde5380c, 23)\
+	MD5_LANES_STEP(MD5_LANES_F3, a, b, c, d, 1, 0xa4beea44, 4) MD5_LANES_STEP(MD5_LANES_F3, d, a, b, c, 4, 0x4bdecfa9, 11)\
+	MD5_LANES_STEP(MD5_LANES_F3, c, d, a, b, 7, 0xf6bb4b60, 16) MD5_LANES_STEP(MD5_LANES_F3, b, c, d, a, 10, 0xbebfbc70, 23)\
+	MD5_LANES_STEP(MD5_LANES_F3, a, b, c, d, 13, 0x289b7ec6, 4) MD5_LANES_STEP(MD5_LANES_F3, d, a, b, c, 0, 0xeaa127fa, 11)\
+	MD5_LANES_STEP(MD5_LANES_F3, c, d, a, b, 3, 0xd4ef3085, 16) MD5_LANES_STEP(MD5_LANES_F3, b, c, d, a, 6, 0x04881d05, 23)\
+	MD5_LANES_STEP(MD5_LANES_F3, a, b, c, d, 9, 0xd9d4d039, 4) MD5_LANES_STEP(MD5_LANES_F3, d, a, b, c, 12, 0xe6db99e5, 11)\
+	MD5_LANES_STEP(MD5_LANES_F3, c, d, a, b, 15, 0x1fa27cf8, 16) MD5_LANES_STEP(MD5_LANES_F3, b, c, d, a, 2, 0xc4ac5665, 23)\
+	MD5_LANES_STEP(MD5_LANES_F4, a, b, c, d, 0, 0xf4292244, 6) MD5_LANES_STEP(MD5_LANES_F4, d, a, b, c, 7, 0x432aff97, 10)\
+	MD5_LANES_STEP(MD5_LANES_F4, c, d, a, b, 14, 0xab9423a7, 15) MD5_LANES_STEP(MD5_LANES_F4, b, c, d, a, 5, 0xfc93a039, 21)\
+	MD5_LANES_STEP(MD5_LANES_F4, a, b, c, d, 12, 0x655b59c3, 6) MD5_LANES_STEP(MD5_LANES_F4, d, a, b, c, 3, 0x8f0ccc92, 10)\
+	MD5_LANES_STEP(MD5_LANES_F4, c, d, a, b, 10, 0xffeff47d, 15) MD5_LANES_STEP(MD5_LANES_F4, b, c, d, a, 1, 0x85845dd1, 21)\
+	MD5_LANES_STEP(MD5_LANES_F4, a, b, c, d, 8, 0x6fa87e4f, 6) MD5_LANES_STEP(MD5_LANES_F4, d, a, b, c, 15, 0xfe2ce6e0, 10)\
+	MD5_LANES_STEP(MD5_LANES_F4, c, d, a, b, 6, 0xa3014314, 15) MD5_LANES_STEP(MD5_LANES_F4, b, c, d, a, 13, 0x4e0811a1, 21)\
+	MD5_LANES_STEP(MD5_LANES_F4, a, b, c, d, 4, 0xf7537e82, 6) MD5_LANES_STEP(MD5_LANES_F4, d, a, b, c, 11, 0xbd3af235, 10)\
+	MD5_LANES_STEP(MD5_LANES_F4, c, d, a, b, 2, 0x2ad7d2bb, 15) MD5_LANES_STEP(MD5_LANES_F4, b, c, d, a, 9, 0xeb86d391, 21)\
+	V_STORE(state+0*V_LANES, V_ADD(a, V_LOAD(state+0*V_LANES))); V_STORE(state+1*V_LANES, V_ADD(b, V_LOAD(state+1*V_LANES)));\
+	V_STORE(state+2*V_LANES, V_ADD(c, V_LOAD(state+2*V_LANES))); V_STORE(state+3*V_LANES, V_ADD(d, V_LOAD(state+3*V_LANES)));
+
+// four lanes in SSE2 registers
+
+#define V_LANES 4
+#define V_TYPE __m128i
+#define V_LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define V_STORE(p, x) _mm_storeu_si128((__m128i *)(p), x)
+#define V_SET1(x) _mm_set1_epi32((int)(x))
+#define V_ADD(x, y) _mm_add_epi32(x, y)
+#define V_AND(x, y) _mm_and_si128(x, y)
+#define V_OR(x, y) _mm_or_si128(x, y)
+#define V_XOR(x, y) _mm_xor_si128(x, y)
+#define V_SHR(x, n) _mm_srli_epi32(x, n)
+#define V_ROTL(x, n) _mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32-(n)))
+#define V_ROTR(x, n) _mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32-(n)))
+
+CRYPTOPP_TARGET("sse2") static void CRYPTOPP_API SHA256_Transform4_SSE2(word32 *state, const word32 *data)
+{
+	SHA256_LANES_BODY
+}
+
+CRYPTOPP_TARGET("sse2") static void CRYPTOPP_API MD5_Transform4_SSE2(word32 *state, const word32 *data)
+{
+	MD5_LANES_BODY
+}
+
+#undef V_LANES
+#undef V_TYPE
+#undef V_LOAD
+#undef V_STORE
+#undef V_SET1
+#undef V_ADD
+#undef V_AND
+#undef V_OR
+#undef V_XOR
+#undef V_SHR
+#undef V_ROTL
+#undef V_ROTR
+
+// eight lanes in AVX2 registers
+
+#define V_LANES 8
+#define V_TYPE __m256i
+#define V_LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define V_STORE(p, x) _mm256_storeu_si256((__m256i *)(p), x)
+#define V_SET1(x) _mm256_set1_epi32((int)(x))
+#define V_ADD(x, y) _mm256_add_epi32(x, y)
+#define V_AND(x, y) _mm256_and_si256(x, y)
+#define V_OR(x, y) _mm256_or_si256(x, y)
+#define V_XOR(x, y) _mm256_xor_si256(x, y)
+#define V_SHR(x, n) _mm256_srli_epi32(x, n)
+#define V_ROTL(x, n) _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32-(n)))
+#define V_ROTR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32-(n)))
+
+CRYPTOPP_TARGET("avx2") static void CRYPTOPP_API SHA256_Transform8_AVX2(word32 *state, const word32 *data)
+{
+	SHA256_LANES_BODY
+}
+
+CRYPTOPP_TARGET("avx2") static void CRYPTOPP_API MD5_Transform8_AVX2(word32 *state, const word32 *data)
+{
+	MD5_LANES_BODY
+}
+
+#undef V_LANES
+#undef V_TYPE
+#undef V_LOAD
+#undef V_STORE
+#undef V_SET1
+#undef V_ADD
+#undef V_AND
+#undef V_OR
+#undef V_XOR
+#undef V_SHR
+#undef V_ROTL
+#undef V_ROTR
+
+#endif	// CRYPTOPP_X86_INTRINSICS_AVAILABLE
+
+struct MultiBufferLane
+{
+	size_t message;		// index of the message in the lane, or count when the lane is idle
+	size_t block, blocks, fullBlocks;
+	byte tail[128];
+};
+
+// A message is hashed as its whole blocks followed by one or two blocks holding the rest of it
+// and the padding, which are built here the way IteratedHashBase::PadLastBlock and
+// TruncatedFinal build them: a 0x80 byte, zeros, and the length in bits.
+static void StartLane(MultiBufferLane &lane, size_t message, const byte *input, size_t length, ByteOrder order)
+{
+	lane.message = message;
+	lane.block = 0;
+	lane.fullBlocks = length / 64;
+
+	size_t rest = length % 64;
+	size_t tailSize = (rest + 1 + 8 <= 64) ? 64 : 128;
+
+	memcpy(lane.tail, input + 64*lane.fullBlocks, rest);
+	lane.tail[rest] = 0x80;
+	memset(lane.tail + rest + 1, 0, tailSize - 8 - rest - 1);
+
+	word32 bitCountLo = word32(length << 3);
+	word32 bitCountHi = word32(length >> 29);
+	PutWord(false, order, lane.tail + tailSize - 8, order == BIG_ENDIAN_ORDER ? bitCountHi : bitCountLo);
+	PutWord(false, order, lane.tail + tailSize - 4, order == BIG_ENDIAN_ORDER ? bitCountLo : bitCountHi);
+
+	lane.blocks = lane.fullBlocks + tailSize / 64;
+}
+
+void MultiBufferHashBase::CalculateDigests(byte *const *digests, const byte *const *messages, const size_t *lengths, size_t count)
+{
+	if (!m_transform)
+	{
+		for (size_t i=0; i<count; i++)
+			m_single->CalculateDigest(digests[i], messages[i], lengths[i]);
+		return;
+	}
+
+	const unsigned int lanes = m_lanes;
+	SecBlock<word32> state(m_stateWords * lanes), data(16 * lanes), initialState(m_stateWords);
+	SecBlock<MultiBufferLane> lane(lanes);
+	size_t next = 0;
+	unsigned int active = 0;
+	unsigned int l, i;
+
+	m_init(initialState);
+	memset(data, 0, data.size() * sizeof(word32));
+
+	for (l=0; l<lanes; l++)
+	{
+		lane[l].message = count;
+		if (next == count)
+			continue;
+
+		StartLane(lane[l], next, messages[next], lengths[next], m_order);
+		for (i=0; i<m_stateWords; i++)
+			state[i*lanes+l] = initialState[i];
+		next++;
+		active++;
+	}
+
+	while (active)
+	{
+		// idle lanes hash whatever they last held, and the result is thrown away
+		for (l=0; l<lanes; l++)
+		{
+			const MultiBufferLane &current = lane[l];
+			if (current.message == count)
+				continue;
+
+			const byte *input = current.block < current.fullBlocks
+				? messages[current.message] + 64*current.block
+				: current.tail + 64*(current.block - current.fullBlocks);
+
+			for (i=0; i<16; i++)
+				data[i*lanes+l] = GetWord<word32>(false, m_order, input + 4*i);
+		}
+
+		m_transform(state, data);
+
+		for (l=0; l<lanes; l++)
+		{
+			MultiBufferLane &current = lane[l];
+			if (current.message == count || ++current.block < current.blocks)
+				continue;
+
+			for (i=0; i<m_digestSize/4; i++)
+				PutWord(false, m_order, digests[current.message] + 4*i, state[i*lanes+l]);
+
+			if (next < count)
+			{
+				StartLane(current, next, messages[next], lengths[next], m_order);
+				for (i=0; i<m_stateWords; i++)
+					state[i*lanes+l] = initialState[i];
+				next++;
+			}
+			else
+			{
+				current.message = count;
+				active--;
+			}
+		}
+	}
+}
+
+static void CRYPTOPP_API SHA256_InitState(word32 *state) {SHA256::InitState(state);}
+static void CRYPTOPP_API MD5_InitState(word32 *state) {MD5::InitState(state);}
+
+MultiBufferHash<SHA256>::MultiBufferHash()
+	: MultiBufferHashBase(new SHA256, SHA256_InitState, BIG_ENDIAN_ORDER, 8)
+{
+#ifdef CRYPTOPP_X86_INTRINSICS_AVAILABLE
+	// SHA256::Transform with the SHA extensions is faster than eight lanes of AVX2
+	if (HasSHA())
+		return;
+	if (HasAVX2())
+		SetLanes(8, SHA256_Transform8_AVX2);
+	else if (HasSSE2())
+		SetLanes(4, SHA256_Transform4_SSE2);
+#endif
+}
+
+MultiBufferHash<MD5>::MultiBufferHash()
+	: MultiBufferHashBase(new MD5, MD5_InitState, LITTLE_ENDIAN_ORDER, 4)
+{
+#ifdef CRYPTOPP_X86_INTRINSICS_AVAILABLE
+	if (HasAVX2())
+		SetLanes(8, MD5_Transform8_AVX2);
+	else if (HasSSE2())
+		SetLanes(4, MD5_Transform4_SSE2);
+#endif
+}
+
+NAMESPACE_END
@@ -0,0 +1,64 @@
+#ifndef CRYPTOPP_MBHASH_H
+#define CRYPTOPP_MBHASH_H
+
+#include "cryptlib.h"
+#include "smartptr.h"
+#include "sha.h"
+#include "md5.h"
+
+NAMESPACE_BEGIN(CryptoPP)
+
+//! _
+class CRYPTOPP_NO_VTABLE MultiBufferHashBase
+{
+public:
+	virtual ~MultiBufferHashBase() {}
+
+	//! number of messages hashed side by side, 1 if the CPU has no suitable vector unit
+	unsigned int Lanes() const {return m_lanes;}
+	unsigned int DigestSize() const {return m_digestSize;}
+
+	//! hash count independent messages, writing DigestSize() bytes for messages[i] to digests[i]
+	/*! Messages may have any lengths. Each lane moves on to the next message as soon as its
+		own is finished, so a mix of short and long messages keeps every lane busy. */
+	void CalculateDigests(byte *const *digests, const byte *const *messages, const size_t *lengths, size_t count);
+
+protected:
+	// state holds word i of lane l at state[i*lanes+l], and data word j of lane l at data[j*lanes+l]
+	typedef void (CRYPTOPP_API * LanesFunction)(word32 *state, const word32 *data);
+	typedef void (CRYPTOPP_API * InitFunction)(word32 *state);
+
+	MultiBufferHashBase(HashTransformation *single, InitFunction init, ByteOrder order, unsigned int stateWords)
+		: m_single(single), m_init(init), m_order(order), m_stateWords(stateWords), m_digestSize(single->DigestSize()), m_lanes(1), m_transform(NULL) {}
+
+	void SetLanes(unsigned int lanes, LanesFunction transform) {m_lanes = lanes; m_transform = transform;}
+
+private:
+	member_ptr<HashTransformation> m_single;
+	InitFunction m_init;
+	ByteOrder m_order;
+	unsigned int m_stateWords, m_digestSize;
+	unsigned int m_lanes;
+	LanesFunction m_transform;
+};
+
+//! hashes several independent messages at once, one per 32-bit lane of an AVX2 or SSE2 register
+/*! Specialized for SHA256 and MD5. Where no vector unit helps it hashes the messages one by one
+	with T, so the digests are always those T would give. */
+template <class T> class MultiBufferHash;
+
+template <> class MultiBufferHash<SHA256> : public MultiBufferHashBase
+{
+public:
+	MultiBufferHash();
+};
+
+template <> class MultiBufferHash<MD5> : public MultiBufferHashBase
+{
+public:
+	MultiBufferHash();
+};
+
+NAMESPACE_END
+
+#endif
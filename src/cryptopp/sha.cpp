@@ -9,9 +9,16 @@
 
 #include "sha.h"
 #include "misc.h"
+#include "cpu.h"
+
+#ifdef CRYPTOPP_X86_INTRINSICS_AVAILABLE
+#include <immintrin.h>
+#endif
 
 NAMESPACE_BEGIN(CryptoPP)
 
+typedef void (CRYPTOPP_API * TransformFunction32)(word32 *state, const word32 *data);
+
 // start of Steve Reid's code
 
 #define blk0(i) (W[i] = data[i])
@@ -38,7 +45,21 @@ void SHA1::InitState(HashWordType *state)
 #define R3(v,w,x,y,z,i) z+=f3(w,x,y)+blk1(i)+0x8F1BBCDC+rotlFixed(v,5);w=rotlFixed(w,30);
 #define R4(v,w,x,y,z,i) z+=f4(w,x,y)+blk1(i)+0xCA62C1D6+rotlFixed(v,5);w=rotlFixed(w,30);
 
+// Transform picks the fastest compression function the CPU supports the first time it is called:
+// SHA-NI, then the SSSE3 message schedule, then the portable code, which is also the reference
+// the others are tested against.
+
 void SHA1::Transform(word32 *state, const word32 *data)
+{
+#ifdef CRYPTOPP_X86_INTRINSICS_AVAILABLE
+	static const TransformFunction32 transform = HasSHA() ? Transform_SHANI : (HasSSSE3() ? Transform_SSSE3 : Transform_CXX);
+	transform(state, data);
+#else
+	Transform_CXX(state, data);
+#endif
+}
+
+void SHA1::Transform_CXX(word32 *state, const word32 *data)
 {
 	word32 W[16];
     /* Copy context->state[] to working vars */
@@ -81,6 +102,143 @@ void SHA1::Transform(word32 *state, const word32 *data)
 
 // end of Steve Reid's code
 
+#ifdef CRYPTOPP_X86_INTRINSICS_AVAILABLE
+
+// the same rounds, with the message schedule and round constant added beforehand
+#define RK1(v,w,x,y,z,i) z+=f1(w,x,y)+WK[i]+rotlFixed(v,5);w=rotlFixed(w,30);
+#define RK2(v,w,x,y,z,i) z+=f2(w,x,y)+WK[i]+rotlFixed(v,5);w=rotlFixed(w,30);
+#define RK3(v,w,x,y,z,i) z+=f3(w,x,y)+WK[i]+rotlFixed(v,5);w=rotlFixed(w,30);
+#define RK4(v,w,x,y,z,i) z+=f4(w,x,y)+WK[i]+rotlFixed(v,5);w=rotlFixed(w,30);
+
+#define ROTL_EPI32(x,n) _mm_or_si128(_mm_slli_epi32(x,n), _mm_srli_epi32(x,32-n))
+
+// the message schedule is worked out four words at a time, then the rounds run as before
+CRYPTOPP_TARGET("ssse3") void SHA1::Transform_SSSE3(word32 *state, const word32 *data)
+{
+	static const word32 K[4] = {0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6};
+	word32 WK[80];
+
+	__m128i X0 = _mm_loadu_si128((const __m128i *)(data+0));
+	__m128i X1 = _mm_loadu_si128((const __m128i *)(data+4));
+	__m128i X2 = _mm_loadu_si128((const __m128i *)(data+8));
+	__m128i X3 = _mm_loadu_si128((const __m128i *)(data+12));
+	__m128i k = _mm_set1_epi32(K[0]);
+
+	_mm_storeu_si128((__m128i *)(WK+0), _mm_add_epi32(X0, k));
+	_mm_storeu_si128((__m128i *)(WK+4), _mm_add_epi32(X1, k));
+	_mm_storeu_si128((__m128i *)(WK+8), _mm_add_epi32(X2, k));
+	_mm_storeu_si128((__m128i *)(WK+12), _mm_add_epi32(X3, k));
+
+	for (unsigned int t=16; t<80; t+=4)
+	{
+		// W[t] = rotl(W[t-3]^W[t-8]^W[t-14]^W[t-16], 1), with W[t+3] needing W[t] from this same step
+		__m128i W = _mm_xor_si128(_mm_xor_si128(X0, _mm_alignr_epi8(X1, X0, 8)), _mm_xor_si128(X2, _mm_srli_si128(X3, 4)));
+		W = ROTL_EPI32(W, 1);
+		__m128i fix = _mm_slli_si128(W, 12);
+		W = _mm_xor_si128(W, ROTL_EPI32(fix, 1));
+
+		X0 = X1; X1 = X2; X2 = X3; X3 = W;
+
+		k = _mm_set1_epi32(K[t/20]);
+		_mm_storeu_si128((__m128i *)(WK+t), _mm_add_epi32(W, k));
+	}
+
+	word32 a = state[0];
+	word32 b = state[1];
+	word32 c = state[2];
+	word32 d = state[3];
+	word32 e = state[4];
+
+	for (unsigned int i=0; i<20; i+=5)
+	{
+		RK1(a,b,c,d,e,i); RK1(e,a,b,c,d,i+1); RK1(d,e,a,b,c,i+2); RK1(c,d,e,a,b,i+3); RK1(b,c,d,e,a,i+4);
+	}
+	for (unsigned int i=20; i<40; i+=5)
+	{
+		RK2(a,b,c,d,e,i); RK2(e,a,b,c,d,i+1); RK2(d,e,a,b,c,i+2); RK2(c,d,e,a,b,i+3); RK2(b,c,d,e,a,i+4);
+	}
+	for (unsigned int i=40; i<60; i+=5)
+	{
+		RK3(a,b,c,d,e,i); RK3(e,a,b,c,d,i+1); RK3(d,e,a,b,c,i+2); RK3(c,d,e,a,b,i+3); RK3(b,c,d,e,a,i+4);
+	}
+	for (unsigned int i=60; i<80; i+=5)
+	{
+		RK4(a,b,c,d,e,i); RK4(e,a,b,c,d,i+1); RK4(d,e,a,b,c,i+2); RK4(c,d,e,a,b,i+3); RK4(b,c,d,e,a,i+4);
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+
+	memset(WK, 0, sizeof(WK));
+}
+
+// the Intel SHA extensions, four rounds per instruction. data is already in native byte order,
+// so only the order of the words in each register has to be reversed.
+CRYPTOPP_TARGET("sha,sse4.1") void SHA1::Transform_SHANI(word32 *state, const word32 *data)
+{
+	__m128i ABCD = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1B);
+	__m128i E0 = _mm_set_epi32(state[4], 0, 0, 0);
+	__m128i E1;
+
+	const __m128i ABCD_SAVE = ABCD;
+	const __m128i E0_SAVE = E0;
+
+	__m128i M0 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(data+0)), 0x1B);
+	__m128i M1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(data+4)), 0x1B);
+	__m128i M2 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(data+8)), 0x1B);
+	__m128i M3 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(data+12)), 0x1B);
+
+	// E alternates between two registers, each group of four rounds adding the next E to its words
+#define SHA1NI_FIRST(m) E0=_mm_add_epi32(E0,m);E1=ABCD;ABCD=_mm_sha1rnds4_epu32(ABCD,E0,0);
+#define SHA1NI_ROUNDS(m,ein,eout,f) ein=_mm_sha1nexte_epu32(ein,m);eout=ABCD;ABCD=_mm_sha1rnds4_epu32(ABCD,ein,f);
+#define SHA1NI_MSG1(m,prev) prev=_mm_sha1msg1_epu32(prev,m);
+#define SHA1NI_MSG2(m,next) next=_mm_sha1msg2_epu32(next,m);
+#define SHA1NI_XOR(m,next2) next2=_mm_xor_si128(next2,m);
+
+	SHA1NI_FIRST(M0);
+	SHA1NI_ROUNDS(M1, E1, E0, 0); SHA1NI_MSG1(M1, M0);
+	SHA1NI_ROUNDS(M2, E0, E1, 0); SHA1NI_MSG1(M2, M1); SHA1NI_XOR(M2, M0);
+	SHA1NI_ROUNDS(M3, E1, E0, 0); SHA1NI_MSG2(M3, M0); SHA1NI_MSG1(M3, M2); SHA1NI_XOR(M3, M1);
+	SHA1NI_ROUNDS(M0, E0, E1, 0); SHA1NI_MSG2(M0, M1); SHA1NI_MSG1(M0, M3); SHA1NI_XOR(M0, M2);
+	SHA1NI_ROUNDS(M1, E1, E0, 1); SHA1NI_MSG2(M1, M2); SHA1NI_MSG1(M1, M0); SHA1NI_XOR(M1, M3);
+	SHA1NI_ROUNDS(M2, E0, E1, 1); SHA1NI_MSG2(M2, M3); SHA1NI_MSG1(M2, M1); SHA1NI_XOR(M2, M0);
+	SHA1NI_ROUNDS(M3, E1, E0, 1); SHA1NI_MSG2(M3, M0); SHA1NI_MSG1(M3, M2); SHA1NI_XOR(M3, M1);
+	SHA1NI_ROUNDS(M0, E0, E1, 1); SHA1NI_MSG2(M0, M1); SHA1NI_MSG1(M0, M3); SHA1NI_XOR(M0, M2);
+	SHA1NI_ROUNDS(M1, E1, E0, 1); SHA1NI_MSG2(M1, M2); SHA1NI_MSG1(M1, M0); SHA1NI_XOR(M1, M3);
+	SHA1NI_ROUNDS(M2, E0, E1, 2); SHA1NI_MSG2(M2, M3); SHA1NI_MSG1(M2, M1); SHA1NI_XOR(M2, M0);
+	SHA1NI_ROUNDS(M3, E1, E0, 2); SHA1NI_MSG2(M3, M0); SHA1NI_MSG1(M3, M2); SHA1NI_XOR(M3, M1);
+	SHA1NI_ROUNDS(M0, E0, E1, 2); SHA1NI_MSG2(M0, M1); SHA1NI_MSG1(M0, M3); SHA1NI_XOR(M0, M2);
+	SHA1NI_ROUNDS(M1, E1, E0, 2); SHA1NI_MSG2(M1, M2); SHA1NI_MSG1(M1, M0); SHA1NI_XOR(M1, M3);
+	SHA1NI_ROUNDS(M2, E0, E1, 2); SHA1NI_MSG2(M2, M3); SHA1NI_MSG1(M2, M1); SHA1NI_XOR(M2, M0);
+	SHA1NI_ROUNDS(M3, E1, E0, 3); SHA1NI_MSG2(M3, M0); SHA1NI_MSG1(M3, M2); SHA1NI_XOR(M3, M1);
+	SHA1NI_ROUNDS(M0, E0, E1, 3); SHA1NI_MSG2(M0, M1); SHA1NI_MSG1(M0, M3); SHA1NI_XOR(M0, M2);
+	SHA1NI_ROUNDS(M1, E1, E0, 3); SHA1NI_MSG2(M1, M2); SHA1NI_XOR(M1, M3);
+	SHA1NI_ROUNDS(M2, E0, E1, 3); SHA1NI_MSG2(M2, M3);
+	SHA1NI_ROUNDS(M3, E1, E0, 3);
+
+#undef SHA1NI_FIRST
+#undef SHA1NI_ROUNDS
+#undef SHA1NI_MSG1
+#undef SHA1NI_MSG2
+#undef SHA1NI_XOR
+
+	E0 = _mm_sha1nexte_epu32(E0, E0_SAVE);
+	ABCD = _mm_add_epi32(ABCD, ABCD_SAVE);
+
+	_mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(ABCD, 0x1B));
+	state[4] = (word32)_mm_extract_epi32(E0, 3);
+}
+
+#undef RK1
+#undef RK2
+#undef RK3
+#undef RK4
+
+#endif
+
 // *************************************************************
 
 void SHA256::InitState(HashWordType *state)
@@ -119,6 +277,16 @@ void SHA256::InitState(HashWordType *state)
 #define s1(x) (rotrFixed(x,17)^rotrFixed(x,19)^(x>>10))
 
 void SHA256::Transform(word32 *state, const word32 *data)
+{
+#ifdef CRYPTOPP_X86_INTRINSICS_AVAILABLE
+	static const TransformFunction32 transform = HasSHA() ? Transform_SHANI : (HasSSSE3() ? Transform_SSSE3 : Transform_CXX);
+	transform(state, data);
+#else
+	Transform_CXX(state, data);
+#endif
+}
+
+void SHA256::Transform_CXX(word32 *state, const word32 *data)
 {
 	word32 W[16];
 	word32 T[8];
@@ -146,6 +314,123 @@ void SHA256::Transform(word32 *state, const word32 *data)
 	memset(T, 0, sizeof(T));
 }
 
+#ifdef CRYPTOPP_X86_INTRINSICS_AVAILABLE
+
+#define RK(i) h(i)+=S1(e(i))+Ch(e(i),f(i),g(i))+WK[i+j];\
+	d(i)+=h(i);h(i)+=S0(a(i))+Maj(a(i),b(i),c(i))
+
+#define ROTR_EPI32(x,n) _mm_or_si128(_mm_srli_epi32(x,n), _mm_slli_epi32(x,32-n))
+#define s0_EPI32(x) _mm_xor_si128(_mm_xor_si128(ROTR_EPI32(x,7), ROTR_EPI32(x,18)), _mm_srli_epi32(x,3))
+#define s1_EPI32(x) _mm_xor_si128(_mm_xor_si128(ROTR_EPI32(x,17), ROTR_EPI32(x,19)), _mm_srli_epi32(x,10))
+
+// the message schedule is worked out four words at a time, then the rounds run as before
+CRYPTOPP_TARGET("ssse3") void SHA256::Transform_SSSE3(word32 *state, const word32 *data)
+{
+	word32 WK[64];
+	word32 T[8];
+
+	__m128i X0 = _mm_loadu_si128((const __m128i *)(data+0));
+	__m128i X1 = _mm_loadu_si128((const __m128i *)(data+4));
+	__m128i X2 = _mm_loadu_si128((const __m128i *)(data+8));
+	__m128i X3 = _mm_loadu_si128((const __m128i *)(data+12));
+
+	_mm_storeu_si128((__m128i *)(WK+0), _mm_add_epi32(X0, _mm_loadu_si128((const __m128i *)(K+0))));
+	_mm_storeu_si128((__m128i *)(WK+4), _mm_add_epi32(X1, _mm_loadu_si128((const __m128i *)(K+4))));
+	_mm_storeu_si128((__m128i *)(WK+8), _mm_add_epi32(X2, _mm_loadu_si128((const __m128i *)(K+8))));
+	_mm_storeu_si128((__m128i *)(WK+12), _mm_add_epi32(X3, _mm_loadu_si128((const __m128i *)(K+12))));
+
+	for (unsigned int t=16; t<64; t+=4)
+	{
+		// W[t] = s1(W[t-2]) + W[t-7] + s0(W[t-15]) + W[t-16]. The last two words need s1 of the first
+		// two, so s1 is added in two halves; the other half is zero each time, and s1(0) is 0.
+		__m128i W = _mm_add_epi32(_mm_add_epi32(X0, s0_EPI32(_mm_alignr_epi8(X1, X0, 4))), _mm_alignr_epi8(X3, X2, 4));
+		W = _mm_add_epi32(W, s1_EPI32(_mm_srli_si128(X3, 8)));
+		W = _mm_add_epi32(W, s1_EPI32(_mm_slli_si128(W, 8)));
+
+		X0 = X1; X1 = X2; X2 = X3; X3 = W;
+
+		_mm_storeu_si128((__m128i *)(WK+t), _mm_add_epi32(W, _mm_loadu_si128((const __m128i *)(K+t))));
+	}
+
+	memcpy(T, state, sizeof(T));
+	for (unsigned int j=0; j<64; j+=16)
+	{
+		RK( 0); RK( 1); RK( 2); RK( 3);
+		RK( 4); RK( 5); RK( 6); RK( 7);
+		RK( 8); RK( 9); RK(10); RK(11);
+		RK(12); RK(13); RK(14); RK(15);
+	}
+	state[0] += a(0);
+	state[1] += b(0);
+	state[2] += c(0);
+	state[3] += d(0);
+	state[4] += e(0);
+	state[5] += f(0);
+	state[6] += g(0);
+	state[7] += h(0);
+
+	memset(WK, 0, sizeof(WK));
+	memset(T, 0, sizeof(T));
+}
+
+// the Intel SHA extensions, two rounds per instruction. The state is kept as ABEF and CDGH.
+CRYPTOPP_TARGET("sha,sse4.1") void SHA256::Transform_SHANI(word32 *state, const word32 *data)
+{
+	__m128i TMP = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(state+0)), 0xB1);	// CDAB
+	__m128i STATE1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(state+4)), 0x1B);	// EFGH
+	__m128i STATE0 = _mm_alignr_epi8(TMP, STATE1, 8);	// ABEF
+	STATE1 = _mm_blend_epi16(STATE1, TMP, 0xF0);		// CDGH
+
+	const __m128i ABEF_SAVE = STATE0;
+	const __m128i CDGH_SAVE = STATE1;
+	__m128i MSG;
+
+	__m128i M0 = _mm_loadu_si128((const __m128i *)(data+0));
+	__m128i M1 = _mm_loadu_si128((const __m128i *)(data+4));
+	__m128i M2 = _mm_loadu_si128((const __m128i *)(data+8));
+	__m128i M3 = _mm_loadu_si128((const __m128i *)(data+12));
+
+#define SHA256NI_ROUNDS(m,i) MSG=_mm_add_epi32(m,_mm_loadu_si128((const __m128i *)(K+i)));\
+	STATE1=_mm_sha256rnds2_epu32(STATE1,STATE0,MSG);MSG=_mm_shuffle_epi32(MSG,0x0E);STATE0=_mm_sha256rnds2_epu32(STATE0,STATE1,MSG);
+#define SHA256NI_MSG1(m,prev) prev=_mm_sha256msg1_epu32(prev,m);
+#define SHA256NI_MSG2(m,prev,next) next=_mm_sha256msg2_epu32(_mm_add_epi32(next,_mm_alignr_epi8(m,prev,4)),m);
+
+	SHA256NI_ROUNDS(M0, 0);
+	SHA256NI_ROUNDS(M1, 4); SHA256NI_MSG1(M1, M0);
+	SHA256NI_ROUNDS(M2, 8); SHA256NI_MSG1(M2, M1);
+	SHA256NI_ROUNDS(M3, 12); SHA256NI_MSG2(M3, M2, M0); SHA256NI_MSG1(M3, M2);
+	SHA256NI_ROUNDS(M0, 16); SHA256NI_MSG2(M0, M3, M1); SHA256NI_MSG1(M0, M3);
+	SHA256NI_ROUNDS(M1, 20); SHA256NI_MSG2(M1, M0, M2); SHA256NI_MSG1(M1, M0);
+	SHA256NI_ROUNDS(M2, 24); SHA256NI_MSG2(M2, M1, M3); SHA256NI_MSG1(M2, M1);
+	SHA256NI_ROUNDS(M3, 28); SHA256NI_MSG2(M3, M2, M0); SHA256NI_MSG1(M3, M2);
+	SHA256NI_ROUNDS(M0, 32); SHA256NI_MSG2(M0, M3, M1); SHA256NI_MSG1(M0, M3);
+	SHA256NI_ROUNDS(M1, 36); SHA256NI_MSG2(M1, M0, M2); SHA256NI_MSG1(M1, M0);
+	SHA256NI_ROUNDS(M2, 40); SHA256NI_MSG2(M2, M1, M3); SHA256NI_MSG1(M2, M1);
+	SHA256NI_ROUNDS(M3, 44); SHA256NI_MSG2(M3, M2, M0); SHA256NI_MSG1(M3, M2);
+	SHA256NI_ROUNDS(M0, 48); SHA256NI_MSG2(M0, M3, M1); SHA256NI_MSG1(M0, M3);
+	SHA256NI_ROUNDS(M1, 52); SHA256NI_MSG2(M1, M0, M2);
+	SHA256NI_ROUNDS(M2, 56); SHA256NI_MSG2(M2, M1, M3);
+	SHA256NI_ROUNDS(M3, 60);
+
+#undef SHA256NI_ROUNDS
+#undef SHA256NI_MSG1
+#undef SHA256NI_MSG2
+
+	STATE0 = _mm_add_epi32(STATE0, ABEF_SAVE);
+	STATE1 = _mm_add_epi32(STATE1, CDGH_SAVE);
+
+	TMP = _mm_shuffle_epi32(STATE0, 0x1B);				// FEBA
+	STATE1 = _mm_shuffle_epi32(STATE1, 0xB1);			// DCHG
+	_mm_storeu_si128((__m128i *)(state+0), _mm_blend_epi16(TMP, STATE1, 0xF0));	// DCBA
+	_mm_storeu_si128((__m128i *)(state+4), _mm_alignr_epi8(STATE1, TMP, 8));	// HGFE
+}
+
+#undef RK
+#undef s0_EPI32
+#undef s1_EPI32
+
+#endif
+
 #undef S0
 #undef S1
 #undef s0
@@ -204,7 +489,19 @@ void SHA512::InitState(HashWordType *state)
 #define s0(x) (rotrFixed(x,1)^rotrFixed(x,8)^(x>>7))
 #define s1(x) (rotrFixed(x,19)^rotrFixed(x,61)^(x>>6))
 
+typedef void (CRYPTOPP_API * TransformFunction64)(word64 *state, const word64 *data);
+
 void SHA512::Transform(word64 *state, const word64 *data)
+{
+#ifdef CRYPTOPP_X86_INTRINSICS_AVAILABLE
+	static const TransformFunction64 transform = HasAVX2() ? Transform_AVX2 : Transform_CXX;
+	transform(state, data);
+#else
+	Transform_CXX(state, data);
+#endif
+}
+
+void SHA512::Transform_CXX(word64 *state, const word64 *data)
 {
 	word64 W[16];
 	word64 T[8];
@@ -232,6 +529,74 @@ void SHA512::Transform(word64 *state, const word64 *data)
 	memset(T, 0, sizeof(T));
 }
 
+#ifdef CRYPTOPP_X86_INTRINSICS_AVAILABLE
+
+#define RK(i) h(i)+=S1(e(i))+Ch(e(i),f(i),g(i))+WK[i+j];\
+	d(i)+=h(i);h(i)+=S0(a(i))+Maj(a(i),b(i),c(i))
+
+#define ROTR_EPI64(x,n) _mm256_or_si256(_mm256_srli_epi64(x,n), _mm256_slli_epi64(x,64-n))
+#define s0_EPI64(x) _mm256_xor_si256(_mm256_xor_si256(ROTR_EPI64(x,1), ROTR_EPI64(x,8)), _mm256_srli_epi64(x,7))
+#define s1_EPI64(x) _mm256_xor_si256(_mm256_xor_si256(ROTR_EPI64(x,19), ROTR_EPI64(x,61)), _mm256_srli_epi64(x,6))
+
+// words 1 to 4 of the eight in hi:lo. alignr only shifts within 128-bit halves, so the middle two words are swapped in first.
+#define ALIGNR_EPI64_1(hi,lo) _mm256_alignr_epi8(_mm256_permute2x128_si256(lo, hi, 0x21), lo, 8)
+
+// W[t] = s1(W[t-2]) + W[t-7] + s0(W[t-15]) + W[t-16]. The last two words need s1 of the first
+// two, so s1 is added in two halves; the other half is zero each time, and s1(0) is 0.
+#define SCHEDULE_EPI64(t) if (t < 80) {\
+	__m256i W = _mm256_add_epi64(_mm256_add_epi64(X0, s0_EPI64(ALIGNR_EPI64_1(X1, X0))), ALIGNR_EPI64_1(X3, X2));\
+	W = _mm256_add_epi64(W, s1_EPI64(_mm256_permute2x128_si256(X3, X3, 0x81)));\
+	W = _mm256_add_epi64(W, s1_EPI64(_mm256_permute2x128_si256(W, W, 0x08)));\
+	X0 = X1; X1 = X2; X2 = X3; X3 = W;\
+	_mm256_storeu_si256((__m256i *)(WK+t), _mm256_add_epi64(W, _mm256_loadu_si256((const __m256i *)(K+t))));}
+
+// the message schedule is worked out four words at a time in AVX2 registers, and the rounds run as before
+CRYPTOPP_TARGET("avx2") void SHA512::Transform_AVX2(word64 *state, const word64 *data)
+{
+	word64 WK[80];
+	word64 T[8];
+
+	__m256i X0 = _mm256_loadu_si256((const __m256i *)(data+0));
+	__m256i X1 = _mm256_loadu_si256((const __m256i *)(data+4));
+	__m256i X2 = _mm256_loadu_si256((const __m256i *)(data+8));
+	__m256i X3 = _mm256_loadu_si256((const __m256i *)(data+12));
+
+	_mm256_storeu_si256((__m256i *)(WK+0), _mm256_add_epi64(X0, _mm256_loadu_si256((const __m256i *)(K+0))));
+	_mm256_storeu_si256((__m256i *)(WK+4), _mm256_add_epi64(X1, _mm256_loadu_si256((const __m256i *)(K+4))));
+	_mm256_storeu_si256((__m256i *)(WK+8), _mm256_add_epi64(X2, _mm256_loadu_si256((const __m256i *)(K+8))));
+	_mm256_storeu_si256((__m256i *)(WK+12), _mm256_add_epi64(X3, _mm256_loadu_si256((const __m256i *)(K+12))));
+
+	// the next four words are worked out during each group of four rounds, so the vector and scalar units run side by side
+	memcpy(T, state, sizeof(T));
+	for (unsigned int j=0; j<80; j+=16)
+	{
+		RK( 0); RK( 1); RK( 2); RK( 3); SCHEDULE_EPI64(j+16);
+		RK( 4); RK( 5); RK( 6); RK( 7); SCHEDULE_EPI64(j+20);
+		RK( 8); RK( 9); RK(10); RK(11); SCHEDULE_EPI64(j+24);
+		RK(12); RK(13); RK(14); RK(15); SCHEDULE_EPI64(j+28);
+	}
+	state[0] += a(0);
+	state[1] += b(0);
+	state[2] += c(0);
+	state[3] += d(0);
+	state[4] += e(0);
+	state[5] += f(0);
+	state[6] += g(0);
+	state[7] += h(0);
+
+	memset(WK, 0, sizeof(WK));
+	memset(T, 0, sizeof(T));
+}
+
+#undef RK
+#undef ROTR_EPI64
+#undef s0_EPI64
+#undef s1_EPI64
+#undef ALIGNR_EPI64_1
+#undef SCHEDULE_EPI64
+
+#endif
+
 const word64 SHA512::K[80] = {
 	W64LIT(0x428a2f98d728ae22), W64LIT(0x7137449123ef65cd),
 	W64LIT(0xb5c0fbcfec4d3b2f), W64LIT(0xe9b5dba58189dbbc),
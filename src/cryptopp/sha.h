@@ -12,6 +12,12 @@ public:
 	static void CRYPTOPP_API InitState(HashWordType *state);
 	static void CRYPTOPP_API Transform(word32 *digest, const word32 *data);
 	static const char * CRYPTOPP_API StaticAlgorithmName() {return "SHA-1";}
+
+protected:
+	// the portable compression function, and the x86 ones Transform picks from at run time
+	static void CRYPTOPP_API Transform_CXX(word32 *digest, const word32 *data);
+	static void CRYPTOPP_API Transform_SSSE3(word32 *digest, const word32 *data);
+	static void CRYPTOPP_API Transform_SHANI(word32 *digest, const word32 *data);
 };
 
 typedef SHA1 SHA;	// for backwards compatibility
@@ -26,6 +32,11 @@ public:
 
 protected:
 	static const word32 K[64];
+
+	// the portable compression function, and the x86 ones Transform picks from at run time
+	static void CRYPTOPP_API Transform_CXX(word32 *digest, const word32 *data);
+	static void CRYPTOPP_API Transform_SSSE3(word32 *digest, const word32 *data);
+	static void CRYPTOPP_API Transform_SHANI(word32 *digest, const word32 *data);
 };
 
 //! implements the SHA-224 standard
@@ -49,6 +60,10 @@ public:
 
 protected:
 	static const word64 K[80];
+
+	// the portable compression function, and the AVX2 one Transform picks instead at run time
+	static void CRYPTOPP_API Transform_CXX(word64 *digest, const word64 *data);
+	static void CRYPTOPP_API Transform_AVX2(word64 *digest, const word64 *data);
 };
 
 //! implements the SHA-384 standard
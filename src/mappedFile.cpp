@@ -0,0 +1,507 @@
+/**************************************************************************
+* File: mappedFile.cpp
+*
+* This provides the implementation for reading a whole file in one go,
+* and for writing a file in one go through a temporary file that is
+* renamed over the original.
+*
+* Author: Hon1nbo
+***************************************************************************/
+
+#include "mappedFile.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+
+#ifdef _WIN32
+        #include "windows.h"
+        #include <io.h>
+        #include <sys/types.h>
+        #include <sys/stat.h>
+#else
+        #include <sys/types.h>
+        #include <sys/stat.h>
+        #include <sys/mman.h>
+        #include <fcntl.h>
+        #include <unistd.h>
+#endif
+
+using namespace std;
+
+#ifdef _WIN32
+
+mappedFile::mappedFile()
+{
+    _data = NULL;
+    _size = 0;
+    _loaded = false;
+    _file = INVALID_HANDLE_VALUE;
+    _mapping = NULL;
+}
+
+#else
+
+mappedFile::mappedFile()
+{
+    _data = NULL;
+    _size = 0;
+    _loaded = false;
+    _file = -1;
+}
+
+#endif
+
+mappedFile::~mappedFile()
+{
+    close();
+}
+
+/**************************************************************
+ * getData returns the start of the mapped file contents.
+ * An empty file has no mapping, so this returns NULL for it.
+ *************************************************************/
+
+const char* mappedFile::getData()
+{
+    return _data;
+}
+
+/****************************************************
+ * getSize returns the length of the mapped contents
+ ***************************************************/
+
+size_t mappedFile::getSize()
+{
+    return _size;
+}
+
+#ifdef _WIN32
+
+/*****************************************************************
+ * open maps a whole file read-only. It returns false if the file
+ * could not be opened or mapped.
+ * Only files that are replaced by a rename, never rewritten in
+ * place, should be mapped. Reading past the end of a mapped file
+ * that has since been cut short kills the process with SIGBUS,
+ * so any other file should be read with load instead.
+ ****************************************************************/
+
+bool mappedFile::open(const char* filePath)
+{
+    close();
+
+    _file = CreateFileA(filePath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+    if (_file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+
+    if (!GetFileSizeEx(_file, &fileSize))
+    {
+        close();
+        return false;
+    }
+
+    _size = (size_t) fileSize.QuadPart;
+
+    if (_size == 0)
+        return true;
+
+    _mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+
+    if (_mapping != NULL)
+        _data = (const char*) MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+
+    if (_data == NULL)
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+/***************************************************************
+ * close unmaps or frees the file. It is safe to call it twice.
+ **************************************************************/
+
+void mappedFile::close()
+{
+    if (_data != NULL && !_loaded)
+        UnmapViewOfFile(_data);
+
+    if (_mapping != NULL)
+        CloseHandle(_mapping);
+
+    if (_file != INVALID_HANDLE_VALUE)
+        CloseHandle(_file);
+
+    _buffer.clear();
+    _data = NULL;
+    _size = 0;
+    _loaded = false;
+    _mapping = NULL;
+    _file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+/*****************************************************************
+ * open maps a whole file read-only. It returns false if the file
+ * could not be opened or mapped.
+ * Only files that are replaced by a rename, never rewritten in
+ * place, should be mapped. Reading past the end of a mapped file
+ * that has since been cut short kills the process with SIGBUS,
+ * so any other file should be read with load instead.
+ ****************************************************************/
+
+bool mappedFile::open(const char* filePath)
+{
+    close();
+
+    _file = ::open(filePath, O_RDONLY);
+
+    if (_file < 0)
+        return false;
+
+    struct stat fileStatus;
+
+    if (fstat(_file, &fileStatus) < 0)
+    {
+        close();
+        return false;
+    }
+
+    _size = (size_t) fileStatus.st_size;
+
+    if (_size == 0)
+        return true;
+
+    void* mapping = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, _file, 0);
+
+    if (mapping == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+
+    _data = (const char*) mapping;
+
+    // messages are read once from front to back
+    madvise(mapping, _size, MADV_SEQUENTIAL);
+
+    return true;
+}
+
+/***************************************************************
+ * close unmaps or frees the file. It is safe to call it twice.
+ **************************************************************/
+
+void mappedFile::close()
+{
+    if (_data != NULL && !_loaded)
+        munmap((void*) _data, _size);
+
+    if (_file >= 0)
+        ::close(_file);
+
+    _buffer.clear();
+    _data = NULL;
+    _size = 0;
+    _loaded = false;
+    _file = -1;
+}
+
+#endif
+
+/*****************************************************************
+ * load reads a whole file into memory in one go. Unlike a mapping
+ * the copy stays whole if another program cuts the file short or
+ * rewrites it while it is being used, so messages and anything
+ * else that may be edited meanwhile are read this way.
+ * The buffer is kept for the next file, so loading many files
+ * with one mappedFile allocates little.
+ * It returns false if the file could not be opened or read.
+ ****************************************************************/
+
+bool mappedFile::load(const char* filePath)
+{
+    close();
+
+    FILE* file = fopen(filePath, "rb");
+
+    if (file == NULL)
+        return false;
+
+    // one byte more than the file size, so a file that has not
+    // changed is read to its end in a single call
+    struct stat fileStatus;
+    size_t capacity = 65536;
+
+    if (fstat(fileno(file), &fileStatus) == 0)
+        capacity = (size_t) fileStatus.st_size + 1;
+
+    _buffer.resize(capacity);
+
+    size_t length = 0;
+    size_t count;
+
+    while ((count = fread(&_buffer[length], 1, _buffer.size() - length, file)) > 0)
+    {
+        length += count;
+
+        if (length == _buffer.size())
+            _buffer.resize(_buffer.size() * 2);
+    }
+
+    bool readOk = (ferror(file) == 0);
+
+    fclose(file);
+
+    if (!readOk)
+    {
+        _buffer.clear();
+        return false;
+    }
+
+    _buffer.resize(length);
+    _loaded = true;
+    _size = length;
+
+    if (_size != 0)
+        _data = _buffer.data();
+
+    return true;
+}
+
+#ifdef _WIN32
+
+/*************************************************************************
+ * beginAtomicWrite creates a temporary file next to filePath to write
+ * the new contents into. A new file gets fileMode if it is not -1.
+ * It returns false if the file could not be created.
+ ************************************************************************/
+
+bool mappedFile::beginAtomicWrite(const char* filePath, atomicWrite& write, int fileMode)
+{
+    char fullPath[MAX_PATH];
+
+    write.file = NULL;
+    write.filePath = (_fullpath(fullPath, filePath, MAX_PATH) != NULL) ? fullPath : filePath;
+
+    size_t found = write.filePath.find_last_of("\\/");
+    string directory = (found == string::npos) ? "." : write.filePath.substr(0, found);
+    char tempFilePath[MAX_PATH];
+
+    if (GetTempFileNameA(directory.c_str(), "BCT", 0, tempFilePath) == 0)
+        return false;
+
+    write.tempFilePath = tempFilePath;
+    write.file = fopen(tempFilePath, "wb");
+
+    if (write.file == NULL)
+    {
+        remove(tempFilePath);
+        return false;
+    }
+
+    return true;
+}
+
+#else
+
+/*************************************************************************
+ * currentFileMask finds the umask, which can only be read by setting it.
+ * Setting it changes it for every thread, so it is read once, while the
+ * program starts and before main can start any threads.
+ ************************************************************************/
+
+static mode_t currentFileMask()
+{
+    mode_t fileMask = umask(077);
+    umask(fileMask);
+
+    return fileMask;
+}
+
+static const mode_t FILE_MASK = currentFileMask();
+
+/*************************************************************************
+ * beginAtomicWrite creates a uniquely named temporary file next to
+ * filePath to write the new contents into.
+ * A symbolic link is followed, so the file it points to is replaced
+ * and the link is kept. The temporary file takes the owner and the
+ * permissions of the file it will replace, or fileMode if that is not
+ * -1. A new file gets fileMode, or the usual 0666 less the umask.
+ * It returns false if the file could not be created.
+ ************************************************************************/
+
+bool mappedFile::beginAtomicWrite(const char* filePath, atomicWrite& write, int fileMode)
+{
+    write.file = NULL;
+    write.filePath = filePath;
+
+    char* resolvedPath = realpath(filePath, NULL);
+
+    if (resolvedPath != NULL)
+    {
+        write.filePath = resolvedPath;
+        free(resolvedPath);
+    }
+    else
+    {
+        // only a file that does not exist yet may be written without
+        // resolving it, a dangling link would be replaced by the file
+        struct stat linkStatus;
+
+        if (errno != ENOENT || lstat(filePath, &linkStatus) == 0)
+            return false;
+    }
+
+    string tempFilePath = write.filePath + ".BCTt.XXXXXX";
+    int tempFile = mkstemp(&tempFilePath[0]);
+
+    if (tempFile < 0)
+        return false;
+
+    struct stat fileStatus;
+    bool created = true;
+
+    if (stat(write.filePath.c_str(), &fileStatus) == 0)
+    {
+        // only root can give a file away, for anyone else the new file
+        // stays theirs, as it would if they had written it themselves
+        if (fchown(tempFile, fileStatus.st_uid, fileStatus.st_gid) != 0)
+            fchown(tempFile, (uid_t) -1, fileStatus.st_gid);
+
+        if (fileMode == -1)
+            fileMode = fileStatus.st_mode & 07777;
+    }
+    else if (fileMode == -1)
+        fileMode = 0666 & ~FILE_MASK;
+
+    if (fchmod(tempFile, (mode_t) fileMode) != 0)
+        created = false;
+
+    if (created)
+        write.file = fdopen(tempFile, "wb");
+
+    if (write.file == NULL)
+    {
+        ::close(tempFile);
+        unlink(tempFilePath.c_str());
+        return false;
+    }
+
+    write.tempFilePath = tempFilePath;
+
+    return true;
+}
+
+#endif
+
+/*************************************************************************
+ * endAtomicWrite flushes and closes a file from beginAtomicWrite and, if
+ * everything was written, renames it over the file it replaces, so a
+ * reader never sees a half written file, nor after a crash an empty one.
+ * Otherwise the temporary file is removed.
+ * Any mapping of the file should be closed first, Windows will not
+ * replace a mapped file.
+ * It returns false if the file could not be written.
+ ************************************************************************/
+
+bool mappedFile::endAtomicWrite(atomicWrite& write, bool written)
+{
+    if (write.file == NULL)
+        return false;
+
+    if (fflush(write.file) != 0)
+        written = false;
+
+#ifdef _WIN32
+    if (written && _commit(_fileno(write.file)) != 0)
+        written = false;
+#else
+    if (written && fsync(fileno(write.file)) != 0)
+        written = false;
+#endif
+
+    if (fclose(write.file) != 0)
+        written = false;
+
+    write.file = NULL;
+
+    if (written)
+    {
+#ifdef _WIN32
+        written = (MoveFileExA(write.tempFilePath.c_str(), write.filePath.c_str(),
+                MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0);
+#else
+        written = (rename(write.tempFilePath.c_str(), write.filePath.c_str()) == 0);
+
+        // the rename itself is only kept once the directory is synced
+        size_t found = write.filePath.find_last_of('/');
+        string directory = (found == string::npos) ? "." : write.filePath.substr(0, found + 1);
+        int directoryFile = ::open(directory.c_str(), O_RDONLY);
+
+        if (directoryFile >= 0)
+        {
+            if (written)
+                fsync(directoryFile);
+
+            ::close(directoryFile);
+        }
+#endif
+    }
+
+    if (!written)
+        remove(write.tempFilePath.c_str());
+
+    return written;
+}
+
+/*************************************************************************
+ * writeAtomic writes a buffer over filePath in one go, the same way.
+ * fileMode is passed on to beginAtomicWrite.
+ * It returns false if the file could not be written.
+ ************************************************************************/
+
+bool mappedFile::writeAtomic(const char* filePath, const char* data, size_t size, int fileMode)
+{
+    atomicWrite write;
+
+    if (!beginAtomicWrite(filePath, write, fileMode))
+        return false;
+
+    bool written = (fwrite(data, 1, size, write.file) == size);
+
+    return endAtomicWrite(write, written);
+}
+
+/*************************************************************************
+ * getFileStatus finds the modification time and size of a file, the
+ * time in nanoseconds where the system keeps it that finely, so two
+ * saves in the same second can still be told apart.
+ * It returns false if the file can not be found.
+ ************************************************************************/
+
+bool mappedFile::getFileStatus(const char* filePath, long long& modified, long long& size)
+{
+    struct stat fileStatus;
+
+    if (stat(filePath, &fileStatus) != 0)
+        return false;
+
+#if defined(__linux__)
+    modified = (long long) fileStatus.st_mtim.tv_sec * 1000000000LL + fileStatus.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+    modified = (long long) fileStatus.st_mtimespec.tv_sec * 1000000000LL + fileStatus.st_mtimespec.tv_nsec;
+#else
+    modified = (long long) fileStatus.st_mtime;
+#endif
+    size = (long long) fileStatus.st_size;
+
+    return true;
+}
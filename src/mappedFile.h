@@ -0,0 +1,64 @@
+/**************************************************************************
+* File: mappedFile.h
+*
+* This provides the interface for reading a whole file in one go,
+* either memory mapped or read in one call, and for writing a file
+* through a temporary file followed by an atomic rename over the
+* original.
+*
+* Author: Hon1nbo
+***************************************************************************/
+
+#ifndef mappedFile_h
+#define mappedFile_h
+
+#include <string>
+#include <cstddef>
+#include <cstdio>
+
+using namespace std;
+
+class mappedFile
+{
+    public:
+            mappedFile();
+            ~mappedFile();
+
+            struct atomicWrite
+            {
+                FILE* file;
+                string filePath;
+                string tempFilePath;
+            };
+
+            bool open(const char*);
+            bool load(const char*);
+            void close();
+
+            const char* getData();
+            size_t getSize();
+
+            static bool writeAtomic(const char*, const char*, size_t, int = -1);
+            static bool beginAtomicWrite(const char*, atomicWrite&, int = -1);
+            static bool endAtomicWrite(atomicWrite&, bool);
+
+            static bool getFileStatus(const char*, long long&, long long&);
+
+    private:
+            mappedFile(const mappedFile&);
+            mappedFile& operator=(const mappedFile&);
+
+            const char* _data;
+            size_t _size;
+            string _buffer;
+            bool _loaded;
+
+#ifdef _WIN32
+            void* _file;
+            void* _mapping;
+#else
+            int _file;
+#endif
+};
+
+#endif
@@ -0,0 +1,311 @@
+/**************************************************************************
+* File: messageEditor.cpp
+*
+* This provides the implementation for tampering with a message in an
+* editor. The directory holding the message is watched rather than the
+* file itself, since some editors save by renaming a new file over it.
+* The watch is set up before the editor starts, so an early save can not
+* be missed. Once a save has been handled the file's status is taken
+* again, so the signed message being written back is not taken for
+* another save.
+*
+* Author: Hon1nbo
+***************************************************************************/
+
+#include "messageEditor.h"
+#include "mappedFile.h"
+#include <iostream>
+#include <cstdlib>
+
+#ifdef _WIN32
+        #include "windows.h"
+#else
+        #include <sys/types.h>
+        #include <sys/wait.h>
+        #include <sys/inotify.h>
+        #include <sys/syscall.h>
+        #include <poll.h>
+        #include <unistd.h>
+#endif
+
+using namespace std;
+
+messageEditor::messageEditor()
+{
+    setEditor("");
+    _fileTime = 0;
+    _fileSize = 0;
+}
+
+messageEditor::messageEditor(string editor)
+{
+    setEditor(editor);
+    _fileTime = 0;
+    _fileSize = 0;
+}
+
+messageEditor::~messageEditor()	{	}
+
+/*************************************************************************
+ * setEditor sets the command that starts the editor, the message path is
+ * added to the end of it. An empty string picks $VISUAL or $EDITOR, and
+ * otherwise Notepad on Windows or vi elsewhere.
+ ************************************************************************/
+
+void messageEditor::setEditor(string editor)
+{
+    if (editor == "" && getenv("VISUAL") != NULL)
+        editor = getenv("VISUAL");
+
+    if (editor == "" && getenv("EDITOR") != NULL)
+        editor = getenv("EDITOR");
+
+    if (editor == "")
+    {
+#ifdef _WIN32
+        editor = "notepad";
+#else
+        editor = "vi";
+#endif
+    }
+
+    _editor = editor;
+}
+
+/******************************************
+ * getEditor returns the editor command
+ *****************************************/
+
+string messageEditor::getEditor()
+{
+    return _editor;
+}
+
+/***************************************************************
+ * hasChanged returns true if the file has a new modification
+ * time or size since the editor was started or it was last
+ * handled
+ **************************************************************/
+
+bool messageEditor::hasChanged(const char* filePath)
+{
+    long long fileTime = 0;
+    long long fileSize = 0;
+
+    if (!mappedFile::getFileStatus(filePath, fileTime, fileSize))
+        return false;
+
+    return (fileTime != _fileTime || fileSize != _fileSize);
+}
+
+#ifdef _WIN32
+
+/*************************************************************************
+ * edit opens the message in the editor and calls saved every time the
+ * file is saved, until the editor is closed. A save is only taken once
+ * the editor has let go of the file, so a half written message is never
+ * signed. If the message has not been handled by then, it is handled
+ * once the editor is closed.
+ * It returns false if the editor could not be started.
+ ************************************************************************/
+
+bool messageEditor::edit(const char* filePath, saveHandler saved, void* context)
+{
+    string path = filePath;
+    size_t found = path.find_last_of("/\\");
+    string directory = (found == string::npos) ? "." : path.substr(0, found + 1);
+
+    mappedFile::getFileStatus(filePath, _fileTime, _fileSize);
+
+    HANDLE change = FindFirstChangeNotificationA(directory.c_str(), FALSE,
+            FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE);
+
+    string commandLine = _editor + " \"" + path + "\"";
+    STARTUPINFOA startup;
+    PROCESS_INFORMATION editor;
+
+    ZeroMemory(&startup, sizeof(startup));
+    startup.cb = sizeof(startup);
+    ZeroMemory(&editor, sizeof(editor));
+
+    if (!CreateProcessA(NULL, (char*) commandLine.c_str(), NULL, NULL, FALSE, 0, NULL, NULL, &startup, &editor))
+    {
+        cerr << "Could not start the editor " << _editor << endl;
+
+        if (change != INVALID_HANDLE_VALUE)
+            FindCloseChangeNotification(change);
+        return false;
+    }
+
+    CloseHandle(editor.hThread);
+
+    HANDLE waitFor[2] = { editor.hProcess, change };
+    DWORD waitCount = (change == INVALID_HANDLE_VALUE) ? 1 : 2;
+    bool handled = false;
+
+    while (true)
+    {
+        DWORD woken = WaitForMultipleObjects(waitCount, waitFor, FALSE, INFINITE);
+
+        if (woken != WAIT_OBJECT_0 + 1)
+            break;
+
+        if (hasChanged(filePath))
+        {
+            // wait for the editor to close the file before signing it
+            HANDLE file = INVALID_HANDLE_VALUE;
+
+            while ((file = CreateFileA(filePath, GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, NULL)) == INVALID_HANDLE_VALUE
+                    && GetLastError() == ERROR_SHARING_VIOLATION)
+                Sleep(10);
+
+            if (file != INVALID_HANDLE_VALUE)
+                CloseHandle(file);
+
+            saved(context, filePath);
+            mappedFile::getFileStatus(filePath, _fileTime, _fileSize);
+            handled = true;
+        }
+
+        if (!FindNextChangeNotification(change))
+            waitCount = 1;
+    }
+
+    if (change != INVALID_HANDLE_VALUE)
+        FindCloseChangeNotification(change);
+
+    CloseHandle(editor.hProcess);
+
+    if (!handled || hasChanged(filePath))
+        saved(context, filePath);
+
+    return true;
+}
+
+#else
+
+/*************************************************************************
+ * edit opens the message in the editor and calls saved every time the
+ * file is saved, until the editor exits. If the message has not been
+ * handled by then, it is handled once the editor has exited.
+ * It returns false if the editor could not be started.
+ ************************************************************************/
+
+bool messageEditor::edit(const char* filePath, saveHandler saved, void* context)
+{
+    string path = filePath;
+    size_t found = path.find_last_of('/');
+    string directory = (found == string::npos) ? "." : path.substr(0, (found == 0) ? 1 : found);
+    string fileName = (found == string::npos) ? path : path.substr(found + 1);
+
+    mappedFile::getFileStatus(filePath, _fileTime, _fileSize);
+
+    int notify = inotify_init();
+
+    if (notify >= 0 && inotify_add_watch(notify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        close(notify);
+        notify = -1;
+    }
+
+    // the editor command goes through the shell so it may carry options
+    string command = _editor + " \"$1\"";
+    pid_t editor = fork();
+
+    if (editor < 0)
+    {
+        cerr << "Could not start the editor " << _editor << endl;
+
+        if (notify >= 0)
+            close(notify);
+        return false;
+    }
+
+    if (editor == 0)
+    {
+        execl("/bin/sh", "sh", "-c", command.c_str(), "sh", filePath, (char*) NULL);
+        _exit(127);
+    }
+
+    // a pidfd wakes poll the moment the editor exits. Without one the
+    // editor is checked on a short timeout instead.
+    int editorExit = -1;
+#ifdef SYS_pidfd_open
+    editorExit = (int) syscall(SYS_pidfd_open, editor, 0);
+#endif
+
+    struct pollfd waiting[2];
+    waiting[0].fd = notify;
+    waiting[0].events = POLLIN;
+    waiting[1].fd = editorExit;
+    waiting[1].events = POLLIN;
+
+    union
+    {
+        struct inotify_event event;
+        char bytes[4096];
+    } buffer;
+
+    int status = 0;
+    bool handled = false;
+
+    while (true)
+    {
+        waiting[0].revents = 0;
+        waiting[1].revents = 0;
+
+        poll(waiting, 2, (editorExit >= 0) ? -1 : 50);
+
+        // a save just before the editor exits is still read below
+        bool editorDone = (waitpid(editor, &status, WNOHANG) == editor);
+
+        if ((waiting[0].revents & POLLIN) == 0)
+        {
+            if (editorDone)
+                break;
+            continue;
+        }
+
+        ssize_t bytesRead = read(notify, buffer.bytes, sizeof(buffer.bytes));
+        bool touched = false;
+
+        for (ssize_t offset = 0; offset < bytesRead; )
+        {
+            const struct inotify_event* event = (const struct inotify_event*) (buffer.bytes + offset);
+
+            if (event->len > 0 && fileName == event->name)
+                touched = true;
+
+            offset += sizeof(struct inotify_event) + event->len;
+        }
+
+        if (touched && hasChanged(filePath))
+        {
+            saved(context, filePath);
+            mappedFile::getFileStatus(filePath, _fileTime, _fileSize);
+            handled = true;
+        }
+
+        if (editorDone)
+            break;
+    }
+
+    if (notify >= 0)
+        close(notify);
+
+    if (editorExit >= 0)
+        close(editorExit);
+
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 127)
+    {
+        cerr << "Could not start the editor " << _editor << endl;
+        return false;
+    }
+
+    if (!handled || hasChanged(filePath))
+        saved(context, filePath);
+
+    return true;
+}
+
+#endif
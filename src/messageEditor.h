@@ -0,0 +1,46 @@
+/**************************************************************************
+* File: messageEditor.h
+*
+* This provides the interface for tampering with a message in an editor.
+* The editor is started on the message file, and the message is handed
+* on to be signed every time it is saved, straight away instead of after
+* a fixed wait. edit returns only once the editor has exited, so a later
+* save is signed too rather than overwriting the signed message.
+* Saves are seen through inotify on Linux and a change notification on
+* Windows, and the editor process is waited on directly.
+*
+* Author: Hon1nbo
+***************************************************************************/
+
+#ifndef messageEditor_h
+#define messageEditor_h
+
+#include <string>
+
+using namespace std;
+
+// called with the message path every time the editor saves it
+typedef void (*saveHandler)(void*, const char*);
+
+class messageEditor
+{
+    public:
+            messageEditor();
+            messageEditor(string);
+            ~messageEditor();
+
+            void setEditor(string);
+            string getEditor();
+
+            bool edit(const char*, saveHandler, void*);
+
+    private:
+            bool hasChanged(const char*);
+
+            string _editor;
+
+            long long _fileTime;
+            long long _fileSize;
+};
+
+#endif
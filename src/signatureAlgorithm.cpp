@@ -10,40 +10,128 @@
 *******************************************************************************/
 
 #include "signatureAlgorithm.h"
-#include "cryptopp/md2.h"
+#include "signingStats.h"
+#include <map>
 #include <string.h>
 
 using namespace std;
 
+/*****************************************************************
+ * The registry maps each supported algorithm name to a factory.
+ * Names are looked up once per configuration by setAlgorithm,
+ * never per message. MAC factories are handed the key.
+ ****************************************************************/
+
+typedef CryptoPP::HashTransformation* (*algorithmFactory)(const byte*, size_t);
+
+template<class Digest>
+    static CryptoPP::HashTransformation* createHash(const byte*, size_t)
+    {
+        return new Digest();
+    }
+
+template<class MAC>
+    static CryptoPP::HashTransformation* createMac(const byte* key, size_t keySize)
+    {
+        return new MAC(key, keySize);
+    }
+
+static map<string, algorithmFactory> buildAlgorithmRegistry()
+{
+    map<string, algorithmFactory> registry;
+
+    registry["md5"] = createHash<CryptoPP::MD5>;
+    registry["md2"] = createHash<CryptoPP::MD2>;
+    registry["md4"] = createHash<CryptoPP::MD4>;
+    registry["sha1"] = createHash<CryptoPP::SHA1>;
+    registry["sha256"] = createHash<CryptoPP::SHA256>;
+    registry["sha512"] = createHash<CryptoPP::SHA512>;
+    registry["sha384"] = createHash<CryptoPP::SHA384>;
+    registry["whirlpool"] = createHash<CryptoPP::Whirlpool>;
+    registry["tiger"] = createHash<CryptoPP::Tiger>;
+    registry["ripemd128"] = createHash<CryptoPP::RIPEMD128>;
+    registry["ripemd256"] = createHash<CryptoPP::RIPEMD256>;
+    registry["ripemd160"] = createHash<CryptoPP::RIPEMD160>;
+    registry["ripemd320"] = createHash<CryptoPP::RIPEMD320>;
+    registry["hmac<md5>"] = createMac<CryptoPP::HMAC<CryptoPP::MD5> >;
+    registry["hmac<md2>"] = createMac<CryptoPP::HMAC<CryptoPP::MD2> >;
+    registry["hmac<md4>"] = createMac<CryptoPP::HMAC<CryptoPP::MD4> >;
+    registry["hmac<sha1>"] = createMac<CryptoPP::HMAC<CryptoPP::SHA1> >;
+    registry["hmac<sha256>"] = createMac<CryptoPP::HMAC<CryptoPP::SHA256> >;
+    registry["hmac<sha384>"] = createMac<CryptoPP::HMAC<CryptoPP::SHA384> >;
+    registry["hmac<sha512>"] = createMac<CryptoPP::HMAC<CryptoPP::SHA512> >;
+
+    return registry;
+}
+
+/*****************************************************************
+ * getAlgorithmRegistry builds the registry the first time it is
+ * called. The local static is initialized only once even when
+ * several threads get here together, so the first lookup may be
+ * made on any thread.
+ ****************************************************************/
+
+static const map<string, algorithmFactory>& getAlgorithmRegistry()
+{
+    static const map<string, algorithmFactory> registry = buildAlgorithmRegistry();
+
+    return registry;
+}
+
 signatureAlgorithm::signatureAlgorithm()
 {
-    signatureAlgorithm("");
+    initialize();
 }
 
 signatureAlgorithm::signatureAlgorithm(string algorithmName)
 {
-    _digestSize = (size_t) 0;
-    _keySize = (size_t) 0;
-    _ready = false;
-    _outputEncoding = "none";
-    _alternateEncoder = false;
+    initialize();
     setAlgorithm(algorithmName);
 }
 
+/****************************************************************
+ * the copy constructor resolves the same algorithm again, so the
+ * copy gets its own Crypto++ instance (keyed the same way) and
+ * can be used on another thread.
+ ***************************************************************/
+
+signatureAlgorithm::signatureAlgorithm(const signatureAlgorithm& other)
+{
+    initialize();
+    setAlgorithm(other._algorithm + ":" + other._outputEncoding);
+}
+
 signatureAlgorithm::~signatureAlgorithm()
 {
-    if (((int) _keySize) == 0)
-        delete [] _digest;
+    delete _hash;
+}
+
+/***************************************************
+ * initialize puts the object into a known state,
+ * with no algorithm selected
+ **************************************************/
+
+void signatureAlgorithm::initialize()
+{
+    _hash = NULL;
+    _digestSize = (size_t) 0;
+    _ready = false;
+    _outputEncoding = "none";
 }
 
 /******************************************************
  * setAlgorithm(string) sets the algorithm to use, and
- * parses out the encoding information if it exists
+ * parses out the encoding information if it exists.
+ * The algorithm is resolved here, and the instance is
+ * kept for every digest made afterwards. MACs are keyed
+ * once here too.
  * 
  * acceptable formats:
  * 
  * algorithm
  * algorithm:encoding
+ * mac*key
+ * mac*key:encoding
  ******************************************************/
 
 void signatureAlgorithm::setAlgorithm(string algorithm)
@@ -57,6 +145,71 @@ void signatureAlgorithm::setAlgorithm(string algorithm)
     }
     else
         _algorithm = algorithm;
+
+    string algorithmName = _algorithm;
+    string key = "";
+
+    found = _algorithm.find("*");
+    if (found < _algorithm.length())
+    {
+        algorithmName = _algorithm.substr(0, found);
+        key = _algorithm.substr(found + 1);
+    }
+
+    delete _hash;
+    _hash = NULL;
+    _digestSize = 0;
+    _ready = false;
+
+    map<string, algorithmFactory>::const_iterator factory = getAlgorithmRegistry().find(algorithmName);
+
+    if (factory == getAlgorithmRegistry().end())
+        return;
+
+    try
+    {
+        _hash = factory->second((const byte*) key.data(), key.length());
+    }
+    catch(const CryptoPP::Exception& e)
+    {
+        cerr << e.what() << endl;
+        _hash = NULL;
+        return;
+    }
+
+    // digests land in a fixed buffer, so nothing is allocated per message
+    if (_hash->DigestSize() > MAX_DIGEST_SIZE)
+    {
+        cerr << "Digest too large for " << algorithmName << endl;
+        delete _hash;
+        _hash = NULL;
+        return;
+    }
+
+    _digestSize = _hash->DigestSize();
+}
+
+/*******************************************************************
+ * getSupportedAlgorithms lists the name of every supported algorithm
+ ******************************************************************/
+
+void signatureAlgorithm::getSupportedAlgorithms(vector<string>& algorithms)
+{
+    algorithms.clear();
+
+    map<string, algorithmFactory>::const_iterator factory;
+
+    for (factory = getAlgorithmRegistry().begin(); factory != getAlgorithmRegistry().end(); factory++)
+        algorithms.push_back(factory->first);
+}
+
+/****************************************************************
+ * isSupported returns true if setAlgorithm found the algorithm
+ ***************************************************************/
+
+bool signatureAlgorithm::isSupported()
+{
+    return (_hash != NULL);
 }
 
 /**********************************************************************
@@ -78,176 +231,160 @@ string signatureAlgorithm::getAlgorithm()
     return _algorithm;
 }
 
+/****************************************************
+ * getOutputEncoding returns the encoding of the digest
+ ***************************************************/
+
+string signatureAlgorithm::getOutputEncoding()
+{
+    return _outputEncoding;
+}
+
 /***********************************************************************
  * getDigest() returns the digest as a string in the requested encoding
  **********************************************************************/
 
 string signatureAlgorithm::getDigest()
+{
+    string output;
+    getDigest(output);
+    return output;
+}
+
+/***********************************************************************
+ * getDigest(string&) writes the digest in the requested encoding into
+ * a buffer owned by the caller. Reusing the same string for every
+ * message means its memory is only allocated once.
+ **********************************************************************/
+
+void signatureAlgorithm::getDigest(string& output)
 {
     if (_ready)
     {
         if (_outputEncoding == "none")
-            return string(reinterpret_cast<const char*>(_digest));
-        else if ((_outputEncoding == "hex") & (_alternateEncoder == false))
-            return getDigestHex();
-        else if ((_outputEncoding == "hex") & (_alternateEncoder == true))
-            return getAlternateDigestHex();
+            output.assign(reinterpret_cast<const char*>(_digest.begin()), _digestSize);
+        else if (_outputEncoding == "hex")
+            getDigestHex(output);
         else if (_outputEncoding == "base64")
-            return getDigestBase64();
+            getDigestBase64(output);
         else
-            return "ERROR";
+            output.assign("ERROR");
     }
     else
-        return "NOT READY";
+        output.assign("NOT READY");
 }
 
-/*************************************************************************
- * runs the digest creation routine. Sets the "_ready" flag if successful.
- *************************************************************************/
+/************************************************************************
+ * getOutput points at the digest in the requested encoding, ready to be
+ * the input of the next algorithm in a chain. With no encoding this is
+ * the raw digest itself, so nothing is copied or encoded. The pointer
+ * stays valid until the next digest is made.
+ ***********************************************************************/
 
-void signatureAlgorithm::createDigest(string input)
+void signatureAlgorithm::getOutput(const byte*& output, size_t& length)
 {
-    bool digestFail = false;
-    size_t found = 0;
-    
-    if (_algorithm == "md5")
-    {
-        doHashDigest<CryptoPP::MD5>(input);
-    }
-    else if (_algorithm == "md2")
-    {
-        doHashDigest<CryptoPP::MD2>(input);
-    }
-    else if (_algorithm == "md4")
-    {
-        doHashDigest<CryptoPP::MD4>(input);
-    }
-    else if (_algorithm == "sha1")
-    {
-        doHashDigest<CryptoPP::SHA1>(input);
-    }
-    else if (_algorithm == "sha256")
-    {
-        doHashDigest<CryptoPP::SHA256>(input);
-    }
-    else if (_algorithm == "sha512")
+    if (_ready && _outputEncoding == "none")
     {
-        doHashDigest<CryptoPP::SHA512>(input);
+        output = _digest.begin();
+        length = _digestSize;
     }
-    else if (_algorithm == "sha384")
-    {
-        doHashDigest<CryptoPP::SHA384>(input);
-    }
-    else if (_algorithm == "whirlpool")
-    {
-        doHashDigest<CryptoPP::Whirlpool>(input);
-    }
-    else if (_algorithm == "tiger")
-    {
-        doHashDigest<CryptoPP::Tiger>(input);
-    }
-    else if (_algorithm == "ripemd128")
-    {
-        doHashDigest<CryptoPP::RIPEMD128>(input);
-    }
-    else if (_algorithm == "ripemd256")
-    {
-        doHashDigest<CryptoPP::RIPEMD256>(input);
-    }
-    else if (_algorithm == "ripemd160")
-    {
-        doHashDigest<CryptoPP::RIPEMD160>(input);
-    }
-    else if (_algorithm == "ripemd320")
-    {
-        doHashDigest<CryptoPP::RIPEMD320>(input);
-    }
-    else if (_algorithm.find("hmac<md5>") < _algorithm.length())
-    {
-        doMacDigest<CryptoPP::HMAC<CryptoPP::MD5> >(input);
-    }
-    else if (_algorithm.find("hmac<md2>") < _algorithm.length())
-    {
-        doMacDigest<CryptoPP::HMAC<CryptoPP::MD2> >(input);
-    }
-    else if (_algorithm.find("hmac<md4>") < _algorithm.length())
-    {
-        doMacDigest<CryptoPP::HMAC<CryptoPP::MD4> >(input);
-    }
-    else if (_algorithm.find("hmac<sha1>") < _algorithm.length())
-    {
-        doMacDigest<CryptoPP::HMAC<CryptoPP::SHA1> >(input);
-    }
-    else if (_algorithm.find("hmac<sha256>") < _algorithm.length())
-    {
-        doMacDigest<CryptoPP::HMAC<CryptoPP::SHA256> >(input);
-    }
-    else if (_algorithm.find("hmac<sha384>") < _algorithm.length())
+    else
     {
-        doMacDigest<CryptoPP::HMAC<CryptoPP::SHA384> >(input);
+        getDigest(_encodedDigest);
+        output = (const byte*) _encodedDigest.data();
+        length = _encodedDigest.length();
     }
-    else if (_algorithm.find("hmac<sha512>") < _algorithm.length())
+}
+
+/*************************************************************************
+ * runs the digest creation routine. Sets the "_ready" flag if successful.
+ *************************************************************************/
+
+void signatureAlgorithm::createDigest(const string& input)
+{
+    createDigest((const byte*) input.data(), input.length());
+}
+
+/*************************************************************************
+ * createDigest(const byte*, size_t) makes the digest of raw bytes, which
+ * may contain NUL characters.
+ *************************************************************************/
+
+void signatureAlgorithm::createDigest(const byte* input, size_t length)
+{
+    if (_hash == NULL)
     {
-        doMacDigest<CryptoPP::HMAC<CryptoPP::SHA512> >(input);
-    }
-    
-    else
-        digestFail = true;
-    
-    if (!digestFail)
-        _ready = true;
-    else
         _ready = false;
+        return;
+    }
+
+    _hash->CalculateDigest( _digest, input, length );
+    _ready = true;
 }
 
-/*****************************************************************************
- * getDigestHex returns the _digest of the algorithm as a hex-encoded string
- *****************************************************************************/
+/*************************************************************************
+ * startDigest, updateDigest and finishDigest make a digest of input that
+ * arrives in pieces, such as a message body that is too large to copy.
+ * The result is the same as createDigest of all the pieces joined.
+ *************************************************************************/
 
-string signatureAlgorithm::getDigestHex()
+void signatureAlgorithm::startDigest()
 {
-    string output;
-    
-    CryptoPP::HexEncoder encoder;
-    
-    encoder.Attach( new CryptoPP::StringSink( output ) );
-    encoder.Put( _digest, _digestSize );
-    encoder.MessageEnd();
-    
-    cout << "Hex Digest: " << output << endl;
-    
-    return output;
+    _ready = false;
+
+    if (_hash != NULL)
+        _hash->Restart();
 }
 
-string signatureAlgorithm::getAlternateDigestHex()
+void signatureAlgorithm::updateDigest(const byte* input, size_t length)
 {
-    string output;
-    string tempDigest = string(reinterpret_cast<const char*>(_digest));
-    
-    CryptoPP::StringSource(tempDigest, true,
-		new CryptoPP::HexEncoder(
-			new CryptoPP::StringSink(output)
-		) // HexEncoder
-	); // StringSource
-    
-    cout << "Hex Digest: " << output << endl;
+    if (_hash != NULL)
+        _hash->Update( input, length );
+}
+
+void signatureAlgorithm::finishDigest()
+{
+    if (_hash == NULL)
+        return;
+
+    _hash->Final( _digest );
+    _ready = true;
+}
+
+/*****************************************************************************
+ * getDigestHex writes the _digest of the algorithm as a hex-encoded string,
+ * in upper case like the Crypto++ HexEncoder
+ *****************************************************************************/
+
+void signatureAlgorithm::getDigestHex(string& output)
+{
+    static const char hex_chars[] = "0123456789ABCDEF";
+
+    output.resize(_digestSize * 2);
+
+    for (size_t i = 0; i < _digestSize; i++)
+    {
+        output[(i * 2)] = hex_chars[(_digest[i] >> 4)];
+        output[(i * 2) + 1] = hex_chars[(_digest[i] & 0x0f)];
+    }
     
-    return output;
+    if (!signingStats::isQuiet())
+        cout << "Hex Digest: " << output << endl;
 }
 
 /**************************************************************************
- * getDigestBase64 returns the _digest of the algorithm as a base64 string
+ * getDigestBase64 writes the _digest of the algorithm as a base64 string
  **************************************************************************/
 
-string signatureAlgorithm::getDigestBase64()
+void signatureAlgorithm::getDigestBase64(string& output)
 {
-    return base64_encode(_digest, _digestSize); // currently using a custom base 64 for documentation issues with crypto++
+    base64_encode(_digest, _digestSize, output); // currently using a custom base 64 for documentation issues with crypto++
 }
 
 
 /*******************************************************************************
  * getDigestBytes returns a pointer to the raw bytes should the calling program
- * use them
+ * use them, or NULL if no digest has been made
  * typedef const unsigned char* bytes
  ******************************************************************************/
 
@@ -256,31 +393,40 @@ byte* signatureAlgorithm::getDigestBytes()
     if (_ready)
         return _digest;
     else
-    {
-        string tmpstr = "0";
-        return (byte*) tmpstr.c_str();//reinterpret_cast<const unsigned char*>
-    }
+        return NULL;
+}
+
+
+/*********************************************************
+ * getDigestSize returns the size of the raw digest bytes
+ ********************************************************/
+
+size_t signatureAlgorithm::getDigestSize()
+{
+    return _digestSize;
 }
 
 
 /*****************************************************************
 * Just a base64 encoder. I had some trouble with the CryptoPP one.
 * Will make the switch back eventually
+* It writes into ret rather than returning a new string.
 ******************************************************************/
 
-string signatureAlgorithm::base64_encode(unsigned char const* bytes_to_encode, unsigned int in_len) {
+void signatureAlgorithm::base64_encode(unsigned char const* bytes_to_encode, unsigned int in_len, string& ret) {
 
-	static const string base64_chars = 
+	static const char base64_chars[] = 
              "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
              "abcdefghijklmnopqrstuvwxyz"
              "0123456789+/";
 
-  string ret;
   int i = 0;
   int j = 0;
   unsigned char char_array_3[3];
   unsigned char char_array_4[4];
 
+  ret.clear();
+
   while (in_len--) {
     char_array_3[i++] = *(bytes_to_encode++);
     if (i == 3) {
@@ -313,6 +459,4 @@ string signatureAlgorithm::base64_encode(unsigned char const* bytes_to_encode, u
 
   }
 
-  return ret;
-
 }
@@ -13,6 +13,7 @@
 #define signatureAlgorithm_h
 
 #include <string>
+#include <vector>
 #include <iostream>
 #include "supportedAlgorithms.h"
 
@@ -23,75 +24,44 @@ class signatureAlgorithm
 	public:
             signatureAlgorithm();
             signatureAlgorithm(string);
+            signatureAlgorithm(const signatureAlgorithm&);
             ~signatureAlgorithm();
+            bool isSupported();
+            static void getSupportedAlgorithms(vector<string>&);
             void setAlgorithm(string);
             void setOutputEncoding(string);
             string getAlgorithm();
+            string getOutputEncoding();
             string getDigest();
+            void getDigest(string&);
+            void getOutput(const byte*&, size_t&);
             byte* getDigestBytes();
-            void createDigest(string);
+            size_t getDigestSize();
+            void createDigest(const string&);
+            void createDigest(const byte*, size_t);
+            void startDigest();
+            void updateDigest(const byte*, size_t);
+            void finishDigest();
+
+            // large enough for every digest in supportedAlgorithms.h
+            enum { MAX_DIGEST_SIZE = 64 };
+
 	private:
+            signatureAlgorithm& operator=(const signatureAlgorithm&);
             
-            template<class Digest>
-                void doHashDigest(string input)
-                {
-                    _digestSize = (Digest::DIGESTSIZE);
-                    cout << "_digestSize: " << _digestSize << endl;
-                    _digest = new byte[ _digestSize ];
-                    Digest().CalculateDigest( _digest, (byte*) input.c_str(), input.length() );
-                    cout << "_digest: " << string(reinterpret_cast<const char*>(_digest)) << endl;
-                }
-            template<class MAC>
-                void doMacDigest(string input)
-                {
-                    _alternateEncoder = true;
-                    string mac;
-                    size_t found = _algorithm.find("*");
-                    string tempKey = _algorithm.substr(found + 1);
-                    cout << "mac key: " << tempKey << endl;
-                   // CryptoPP::SecByteBlock key(tempKey.length());
-                    _keySize = tempKey.length();
-                    cout << "_keySize: " << _keySize << endl;
-                    _key = new byte[ _keySize ];
-                    _key = (byte*) tempKey.c_str();
-                    
-                    _digestSize = MAC::DIGESTSIZE;
-                    
-                    cout << "_digestSize: " << _digestSize << endl;
-                    
-                    try
-                    {
-                            MAC xmac(_key, _keySize);		
-                            CryptoPP::StringSource(input, true, 
-                                    new CryptoPP::HashFilter(xmac,
-                                            new CryptoPP::StringSink(mac)
-                                    ) // HashFilter      
-                            ); // StringSource
-                            
-                            _digest = new byte[ _digestSize ];
-                            _digest = (byte*) mac.c_str();
-                            cout << "mac: " << mac << endl;
-                    }
-                    catch(const CryptoPP::Exception& e)
-                    {
-                            cerr << e.what() << endl;
-                            exit(1);
-                    }
-                }
-            
-            string getDigestHex();
-            string getAlternateDigestHex();
-            string getDigestBase64();
-            string base64_encode(unsigned char const*, unsigned int);
+            void getDigestHex(string&);
+            void getDigestBase64(string&);
+            void base64_encode(unsigned char const*, unsigned int, string&);
+
+            void initialize();
 
             string _algorithm;
             string _outputEncoding;
-            byte* _digest;
-            byte* _key;
+            CryptoPP::HashTransformation* _hash;   // resolved once by setAlgorithm
+            CryptoPP::FixedSizeSecBlock<byte, MAX_DIGEST_SIZE> _digest;
             size_t _digestSize;
-            size_t _keySize;
+            string _encodedDigest;      // reused by getOutput
             bool _ready;
-            bool _alternateEncoder;
 };
 
 #endif
@@ -10,41 +10,102 @@
 ****************************************************************************/
 
 #include "signatureConfig.h"
+#include "mappedFile.h"
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
+#include <cctype>
 #include <iostream>
+#include <sstream>
 
 using namespace std;
 
+// how much of the body is handed to the hash at a time, so a large
+// mapped body is read through once from front to back
+static const size_t BODY_CHUNK_SIZE = 1 << 20;
+
+// the compiled form of a configuration file is kept next to it
+static const char COMPILED_CONFIG_EXTENSION[] = ".BCTt.cache";
+static const char COMPILED_CONFIG_MAGIC[8] = { 'B', 'C', 'T', 't', 'C', 'F', 'G', '1' };
+static const unsigned int COMPILED_CONFIG_VERSION = 3;
+
 signatureConfig::signatureConfig()
 {
-	string tempFilePath = "temp_message.txt";
-	_tempFilePath = (char*)tempFilePath.c_str();
+	_tempFilePath = (char*) "temp_message.txt";
 	_doFinalString = "";
+	_doFinalPlanError = false;
 	_signatureParameter = "";
-	string configFilePath = "config.txt";
-	_configFilePath = (char*)configFilePath.c_str();
+	_configFilePath = "config.txt";
         _oldSignature = "";
+        _oldSignatureOffset = string::npos;
+        _stats = NULL;
         _error = false;
 }
 
 signatureConfig::signatureConfig(char* filePath)
 {
-	signatureConfig();
+	_tempFilePath = (char*) "temp_message.txt";
+	_doFinalString = "";
+	_doFinalPlanError = false;
+	_signatureParameter = "";
 	_configFilePath = filePath;
+        _oldSignature = "";
+        _oldSignatureOffset = string::npos;
+        _stats = NULL;
+        _error = false;
+}
+
+/*********************************************************************
+ * the copy constructor makes a deep copy, with its own parameters and
+ * its own instances of every algorithm. Crypto++ hash objects are not
+ * thread safe, so every signing thread works on a copy like this.
+ ********************************************************************/
+
+signatureConfig::signatureConfig(const signatureConfig& other)
+{
+	_tempFilePath = other._tempFilePath;
+	_configFilePath = other._configFilePath;
+	_doFinalString = other._doFinalString;
+	_doFinalPlan = other._doFinalPlan;
+	_doFinalPlanError = other._doFinalPlanError;
+	_signatureParameter = other._signatureParameter;
+        _oldSignature = "";
+        _oldSignatureOffset = string::npos;
+        _stats = NULL;      // each copy is timed by its own thread's stats
+        _error = other._error;
+
+	for (size_t i = 0; i < other._signatureAlgorithm.size(); i++)
+		_signatureAlgorithm.push_back(new signatureAlgorithm(*other._signatureAlgorithm[i]));
+
+	for (size_t i = 0; i < other._parseParameter.size(); i++)
+		_parseParameter.push_back(new signingParameter(*other._parseParameter[i]));
+
+	for (size_t i = 0; i < other._postParseParameter.size(); i++)
+		_postParseParameter.push_back(new signingParameter(*other._postParseParameter[i]));
+
+	for (size_t i = 0; i < other._computedParameter.size(); i++)
+		_computedParameter.push_back((other._computedParameter[i] == NULL) ? NULL : new computedParameter(*other._computedParameter[i]));
+
+	_computedHeader = other._computedHeader;
+	_computedOffset = other._computedOffset;
+	_computedLength = other._computedLength;
 }
 
 signatureConfig::~signatureConfig()
 {
 	// start by de-allocating dynamic memory from objects.
 
-	for (int i = 0; i < _signatureAlgorithm.size(); i++)
+	for (size_t i = 0; i < _signatureAlgorithm.size(); i++)
 		delete _signatureAlgorithm[i];
 		
-	for (int i = 0; i < _parseParameter.size(); i++)
+	for (size_t i = 0; i < _parseParameter.size(); i++)
 		delete _parseParameter[i];
 
-	for (int i = 0; i < _postParseParameter.size(); i++)
+	for (size_t i = 0; i < _postParseParameter.size(); i++)
 		delete _postParseParameter[i];
+
+	for (size_t i = 0; i < _computedParameter.size(); i++)
+		delete _computedParameter[i];
 		
 }
 
@@ -59,78 +120,354 @@ void signatureConfig::setConfigFilePath(char* filePath)
 
 /************************************************************************
  * parseConfigFile opens and parses the data from the configuration file
- * and creates objects to sign a message as needed
+ * and creates objects to sign a message as needed.
+ * The first time a file is parsed, its compiled form is written next to
+ * it. Later runs load that instead, as long as the configuration file
+ * has the same modification time, size and SHA-256 hash as when it was
+ * compiled. The file is read once, and the text that is hashed is the
+ * text that is parsed.
  ***********************************************************************/
 
 void signatureConfig::parseConfigFile()
 {
-	_configFile.open(_configFilePath);
-	
-	if (!_configFile.is_open())
+	long long configTime = 0;
+	long long configSize = 0;
+	bool haveStatus = mappedFile::getFileStatus(_configFilePath.c_str(), configTime, configSize);
+	string compiledFilePath = _configFilePath + COMPILED_CONFIG_EXTENSION;
+	mappedFile configFile;
+
+	if (!configFile.load(_configFilePath.c_str()))
         {
 		cerr << "Could not open the configuration file!" << endl;
                 _error = true;
         }
 	else
 	{
+		string configText(configFile.getData() != NULL ? configFile.getData() : "", configFile.getSize());
+		string configHash(CryptoPP::SHA256::DIGESTSIZE, '\0');
+
+		CryptoPP::SHA256().CalculateDigest((byte*) &configHash[0], (const byte*) configText.data(), configText.length());
+		configFile.close();
+
+		if (haveStatus && loadCompiledConfig(compiledFilePath.c_str(), configTime, configSize, configHash))
+		{
+			checkConfig();
+			return;
+		}
+
+		istringstream configLines(configText);
 		string tempLine = "";
+		string keyword = "";
 		size_t found = 0;
 		
-		// parse out the information needed for signing
-		while (!_configFile.eof())
+		// parse out the information needed for signing.
+		// The keyword is everything before the first ':' on the line,
+		// so a keyword inside a value can not be mistaken for one.
+		while (getline(configLines, tempLine))
 		{
-			getline(_configFile, tempLine);
+			found = tempLine.find(':');
+
+			if (found == string::npos)
+				continue;
+
+			keyword = tempLine.substr(0, found);
+			tempLine = tempLine.substr( (found + 1) );
+
+			if (tempLine.length() > 0 && tempLine[tempLine.length() - 1] == '\r')
+				tempLine = tempLine.substr(0, (tempLine.length() - 1));
 		
-			if (tempLine.find("algorithm:") < tempLine.length())
-			{
-				found = tempLine.find("algorithm:");
-				tempLine = tempLine.substr( (found + 10) );
-                                tempLine = tempLine.substr(0, (tempLine.length() - 1));
+			if (keyword == "algorithm")
 				addAlgorithm(tempLine);
-			}
-			else if (tempLine.find("signatureParameter:") < tempLine.length())
-			{
-				found = tempLine.find("signatureParameter:");
-				tempLine = tempLine.substr( (found + 19) );
-                                tempLine = tempLine.substr(0, (tempLine.length() - 1));
+			else if (keyword == "signatureParameter")
 				setSignatureParameter(tempLine);
-			}
-			else if (tempLine.find("parseParameter:") < tempLine.length())
+			else if (keyword == "parseParameter")
 			{
-				found = tempLine.find("parseParameter:");
-				tempLine = tempLine.substr( (found + 15) );
-                                tempLine = tempLine.substr(0, (tempLine.length() - 1));
 				addParseParameter(tempLine);
-                                cout << "Parser Parameter: " << tempLine << endl;
+
+				if (!signingStats::isQuiet())
+					cout << "Parser Parameter: " << tempLine << endl;
 			}
-			else if (tempLine.find("postParseParameter:") < tempLine.length())
+			else if (keyword == "postParseParameter")
 			{
-				found = tempLine.find("postParseParameter:");
-				tempLine = tempLine.substr( (found + 19) );
-                                tempLine = tempLine.substr(0, (tempLine.length() - 1));
 				addPostParseParameter(tempLine);
-                                cout << "Post-Parse Parameter: " << tempLine << endl;
+
+				if (!signingStats::isQuiet())
+					cout << "Post-Parse Parameter: " << tempLine << endl;
 			}
-			else if (tempLine.find("doFinalString:") < tempLine.length())
-			{
-				found = tempLine.find("doFinalString:");
-				tempLine = tempLine.substr( (found + 14) );
-                                //tempLine = tempLine.substr(0, (tempLine.length() - 1));
+			else if (keyword == "doFinalString")
 				setDoFinalString(tempLine);
-			}
 		}
-		
-		_configFile.close();
-	
-		// make sure we have enough information to execute a signing
-		if (  ((int) _signatureAlgorithm.size() > 0) & ( ((int) _parseParameter.size() > 0) || ((int )_postParseParameter.size() > 0) ) & (_doFinalString != "") & (_signatureParameter != "") )
-			_error = false;
-		else
-                {
-			cerr << "Not enough information is parsed to sign a message!" << endl;
-                        _error = true;
-                }
+
+		checkConfig();
+
+		if (!_error && haveStatus)
+			saveCompiledConfig(compiledFilePath.c_str(), configTime, configSize, configHash);
+	}
+}
+
+/*************************************************************
+ * checkConfig makes sure there is enough information parsed
+ * to sign a message, and sets the error flag if not
+ ************************************************************/
+
+void signatureConfig::checkConfig()
+{
+	// make sure we have enough information to execute a signing
+	if (  ((int) _signatureAlgorithm.size() > 0) & ( ((int) _parseParameter.size() > 0) || ((int )_postParseParameter.size() > 0) ) & (_doFinalString != "") & (_signatureParameter != "") )
+		_error = false;
+	else
+        {
+		cerr << "Not enough information is parsed to sign a message!" << endl;
+                _error = true;
+        }
+
+	for (size_t i = 0; i < _signatureAlgorithm.size(); i++)
+	{
+		if (!_error && !_signatureAlgorithm[i]->isSupported())
+		{
+			cerr << "Unsupported algorithm: " << _signatureAlgorithm[i]->getAlgorithm() << endl;
+			_error = true;
+		}
+	}
+
+	if (!_error && !checkComputedParameters())
+		_error = true;
+
+	if (!_error && !checkDoFinalPlan())
+	{
+		cerr << "The doFinalString does not match the parameters given!" << endl;
+		_error = true;
+	}
+}
+
+/***************************************************************************
+ * The compiled configuration is a flat list of fields in this order:
+ *
+ *   magic "BCTtCFG1", the format version COMPILED_CONFIG_VERSION (which
+ *   also catches a different byte order),
+ *   the modification time and size of the configuration file,
+ *   the SHA-256 of the configuration text, as a string,
+ *   signatureParameter, doFinalString,
+ *   each algorithm as name and output encoding,
+ *   each parseParameter identifier,
+ *   each postParseParameter identifier and value,
+ *   each doFinal plan entry as source, index and literal.
+ *
+ * Lists start with their length. Numbers are 4 bytes, times and sizes are
+ * 8 bytes, and strings are a 4 byte length followed by the characters,
+ * all in the byte order of the machine that wrote it. The cache is only
+ * ever read back on the machine that wrote it.
+ **************************************************************************/
+
+static void writeNumber(string& output, unsigned int value)
+{
+	output.append((const char*) &value, sizeof(value));
+}
+
+static void writeLong(string& output, long long value)
+{
+	output.append((const char*) &value, sizeof(value));
+}
+
+static void writeString(string& output, const string& value)
+{
+	writeNumber(output, (unsigned int) value.length());
+	output.append(value);
+}
+
+// reads fields from a compiled configuration, clearing ok on a short file
+struct compiledReader
+{
+	const char* data;
+	size_t size;
+	size_t offset;
+	bool ok;
+};
+
+static bool readBytes(compiledReader& input, void* value, size_t length)
+{
+	if (!input.ok || input.size - input.offset < length)
+	{
+		input.ok = false;
+		return false;
+	}
+
+	memcpy(value, input.data + input.offset, length);
+	input.offset += length;
+	return true;
+}
+
+static unsigned int readNumber(compiledReader& input)
+{
+	unsigned int value = 0;
+	readBytes(input, &value, sizeof(value));
+	return value;
+}
+
+static long long readLong(compiledReader& input)
+{
+	long long value = 0;
+	readBytes(input, &value, sizeof(value));
+	return value;
+}
+
+static string readString(compiledReader& input)
+{
+	unsigned int length = readNumber(input);
+
+	if (!input.ok || input.size - input.offset < length)
+	{
+		input.ok = false;
+		return "";
 	}
+
+	string value(input.data + input.offset, length);
+	input.offset += length;
+	return value;
+}
+
+/*************************************************************************
+ * saveCompiledConfig writes the parsed configuration in compiled form,
+ * tagged with the modification time, size and hash of the configuration
+ * file. It holds the keys, so only the owner may read it.
+ * Failing to write it is not an error, the text file is parsed next time.
+ ************************************************************************/
+
+void signatureConfig::saveCompiledConfig(const char* compiledFilePath, long long configTime, long long configSize, const string& configHash)
+{
+	string output;
+
+	output.append(COMPILED_CONFIG_MAGIC, sizeof(COMPILED_CONFIG_MAGIC));
+	writeNumber(output, COMPILED_CONFIG_VERSION);
+	writeLong(output, configTime);
+	writeLong(output, configSize);
+	writeString(output, configHash);
+
+	writeString(output, _signatureParameter);
+	writeString(output, _doFinalString);
+
+	writeNumber(output, (unsigned int) _signatureAlgorithm.size());
+	for (size_t i = 0; i < _signatureAlgorithm.size(); i++)
+	{
+		writeString(output, _signatureAlgorithm[i]->getAlgorithm());
+		writeString(output, _signatureAlgorithm[i]->getOutputEncoding());
+	}
+
+	writeNumber(output, (unsigned int) _parseParameter.size());
+	for (size_t i = 0; i < _parseParameter.size(); i++)
+		writeString(output, _parseParameter[i]->getParameterIdentifier());
+
+	writeNumber(output, (unsigned int) _postParseParameter.size());
+	for (size_t i = 0; i < _postParseParameter.size(); i++)
+	{
+		writeString(output, _postParseParameter[i]->getParameterIdentifier());
+		writeString(output, _postParseParameter[i]->getParameterValue());
+	}
+
+	writeNumber(output, (unsigned int) _doFinalPlan.size());
+	for (size_t i = 0; i < _doFinalPlan.size(); i++)
+	{
+		writeNumber(output, (unsigned int) _doFinalPlan[i].source);
+		writeNumber(output, (unsigned int) _doFinalPlan[i].index);
+		writeString(output, _doFinalPlan[i].literal);
+	}
+
+	mappedFile::writeAtomic(compiledFilePath, output.data(), output.length(), 0600);
+}
+
+/*************************************************************************
+ * loadCompiledConfig maps a compiled configuration and, if it was made
+ * from the configuration file as it is now, sets everything up from it
+ * without parsing any text.
+ * It returns false, changing nothing, if there is no usable compiled
+ * configuration.
+ ************************************************************************/
+
+bool signatureConfig::loadCompiledConfig(const char* compiledFilePath, long long configTime, long long configSize, const string& configHash)
+{
+	mappedFile compiledFile;
+
+	if (!compiledFile.open(compiledFilePath))
+		return false;
+
+	compiledReader input;
+	input.data = compiledFile.getData();
+	input.size = compiledFile.getSize();
+	input.offset = 0;
+	input.ok = true;
+
+	char magic[sizeof(COMPILED_CONFIG_MAGIC)];
+
+	if (!readBytes(input, magic, sizeof(magic)) || memcmp(magic, COMPILED_CONFIG_MAGIC, sizeof(magic)) != 0)
+		return false;
+
+	if (readNumber(input) != COMPILED_CONFIG_VERSION || readLong(input) != configTime || readLong(input) != configSize)
+		return false;
+
+	if (readString(input) != configHash || !input.ok)
+		return false;
+
+	// read everything before touching the configuration,
+	// so a damaged file leaves it as it was
+	string signatureParameter = readString(input);
+	string doFinalString = readString(input);
+
+	vector<string> algorithms;
+	unsigned int count = readNumber(input);
+	for (unsigned int i = 0; i < count && input.ok; i++)
+	{
+		string algorithm = readString(input);
+		string encoding = readString(input);
+		algorithms.push_back(algorithm + ":" + encoding);
+	}
+
+	vector<string> parseParameters;
+	count = readNumber(input);
+	for (unsigned int i = 0; i < count && input.ok; i++)
+		parseParameters.push_back(readString(input));
+
+	vector<string> postParseIdentifiers;
+	vector<string> postParseValues;
+	count = readNumber(input);
+	for (unsigned int i = 0; i < count && input.ok; i++)
+	{
+		postParseIdentifiers.push_back(readString(input));
+		postParseValues.push_back(readString(input));
+	}
+
+	vector<doFinalEntry> doFinalPlan;
+	count = readNumber(input);
+	for (unsigned int i = 0; i < count && input.ok; i++)
+	{
+		doFinalEntry entry;
+		entry.source = (doFinalSource) readNumber(input);
+		entry.index = readNumber(input);
+		entry.literal = readString(input);
+
+		if (entry.source > DOFINAL_BODY)
+			input.ok = false;
+
+		doFinalPlan.push_back(entry);
+	}
+
+	if (!input.ok || input.offset != input.size)
+		return false;
+
+	_signatureParameter = signatureParameter;
+	_doFinalString = doFinalString;
+	_doFinalPlan = doFinalPlan;
+	_doFinalPlanError = false;
+
+	for (size_t i = 0; i < algorithms.size(); i++)
+		addAlgorithm(algorithms[i]);
+
+	for (size_t i = 0; i < parseParameters.size(); i++)
+		addParseParameter(parseParameters[i]);
+
+	for (size_t i = 0; i < postParseIdentifiers.size(); i++)
+		_postParseParameter.push_back(new signingParameter(postParseIdentifiers[i], postParseValues[i]));
+
+	return true;
 }
 
 /************************************************************************
@@ -174,8 +511,8 @@ void signatureConfig::addPostParseParameter(string parameter)
 		parameterIdentifier = parameter.substr(0, found);
 		parameterValue = parameter.substr( (found + 1) );
                 
-                if (parameterValue[(parameterValue.length() - 1)] == ('\r' || '\n') )
-                        parameterValue = parameterValue.substr(0, (parameterValue.length() - 1) );
+                while (parameterValue.length() > 0 && (parameterValue[parameterValue.length() - 1] == '\r' || parameterValue[parameterValue.length() - 1] == '\n'))
+                        parameterValue.erase(parameterValue.length() - 1);
 	}
 	
 	if ( (parameterIdentifier != "") & (parameterValue != "") )
@@ -187,12 +524,215 @@ void signatureConfig::addPostParseParameter(string parameter)
 
 /********************************************************************
  * setDoFinalString sets the layout of the final string input to the
- * cryptographic functions
+ * cryptographic functions.
+ * The layout is compiled here, once, into an ordered list of parameter
+ * references and literal text, so signing a message only has to walk
+ * that list. Entries are separated by '.', and can be:
+ *
+ * parseParameter-NN
+ * postParseParameter-NN
+ * literal-TEXT     (TEXT may use \. \\ \r \n and \t)
  *******************************************************************/
 
 void signatureConfig::setDoFinalString(string finalStringLayout)
 {
+	// the config file parser leaves the line ending on this one
+	while (finalStringLayout.length() > 0 && (finalStringLayout[finalStringLayout.length() - 1] == '\r' || finalStringLayout[finalStringLayout.length() - 1] == '\n'))
+		finalStringLayout = finalStringLayout.substr(0, (finalStringLayout.length() - 1));
+
 	_doFinalString = finalStringLayout;
+	_doFinalPlan.clear();
+	_doFinalPlanError = false;
+
+	string token = "";
+
+	for (size_t i = 0; i <= finalStringLayout.length(); i++)
+	{
+		if (i < finalStringLayout.length() && finalStringLayout[i] == '\\' && (i + 1) < finalStringLayout.length())
+		{
+			// keep escapes for the literal decoding below
+			token += finalStringLayout.substr(i, 2);
+			i++;
+			continue;
+		}
+
+		if (i < finalStringLayout.length() && finalStringLayout[i] != '.')
+		{
+			token += finalStringLayout[i];
+			continue;
+		}
+
+		if (token == "")
+			continue;
+
+		doFinalEntry entry;
+		entry.index = 0;
+
+		if (token.find("postParseParameter-") == 0)
+		{
+			entry.source = DOFINAL_POST_PARSE;
+			entry.index = (size_t) atoi(token.substr(19).c_str());
+		}
+		else if (token.find("parseParameter-") == 0)
+		{
+			entry.source = DOFINAL_PARSE;
+			entry.index = (size_t) atoi(token.substr(15).c_str());
+		}
+		else if (token.find("literal-") == 0)
+		{
+			entry.source = DOFINAL_LITERAL;
+
+			for (size_t j = 8; j < token.length(); j++)
+			{
+				if (token[j] == '\\' && (j + 1) < token.length())
+				{
+					j++;
+					if (token[j] == 'r')
+						entry.literal += '\r';
+					else if (token[j] == 'n')
+						entry.literal += '\n';
+					else if (token[j] == 't')
+						entry.literal += '\t';
+					else
+						entry.literal += token[j];
+				}
+				else
+					entry.literal += token[j];
+			}
+		}
+		else
+		{
+			cerr << "Unknown doFinalString entry: " << token << endl;
+			_doFinalPlanError = true;
+			token = "";
+			continue;
+		}
+
+		_doFinalPlan.push_back(entry);
+		token = "";
+	}
+}
+
+/*************************************************************************
+ * checkComputedParameters sets up a computedParameter for every post
+ * parse parameter whose value asks for one. The parameter's identifier
+ * is the name of the header its value is written into.
+ * It returns false if a computed value is not understood.
+ ************************************************************************/
+
+bool signatureConfig::checkComputedParameters()
+{
+	for (size_t i = 0; i < _computedParameter.size(); i++)
+		delete _computedParameter[i];
+
+	_computedParameter.assign(_postParseParameter.size(), NULL);
+	_computedHeader.assign(_postParseParameter.size(), "");
+	_computedOffset.assign(_postParseParameter.size(), string::npos);
+	_computedLength.assign(_postParseParameter.size(), 0);
+
+	for (size_t i = 0; i < _postParseParameter.size(); i++)
+	{
+		const string& value = _postParseParameter[i]->getParameterValue();
+
+		if (!computedParameter::isComputed(value))
+			continue;
+
+		_computedParameter[i] = new computedParameter();
+
+		if (!_computedParameter[i]->setSpecification(value))
+		{
+			cerr << "Unknown computed parameter: " << value << endl;
+			return false;
+		}
+
+		_computedHeader[i] = _postParseParameter[i]->getParameterIdentifier();
+	}
+
+	return true;
+}
+
+/*************************************************************************
+ * findComputedHeader finds the computed parameter written into the
+ * header a parse parameter such as "X-Message-Timestamp: " reads, by
+ * the header name before its ':'. Header names are compared without
+ * their case.
+ * It returns string::npos if that header is not computed.
+ ************************************************************************/
+
+size_t signatureConfig::findComputedHeader(const string& identifier)
+{
+	size_t nameLength = identifier.find(':');
+
+	if (nameLength == string::npos)
+		return string::npos;
+
+	for (size_t i = 0; i < _computedHeader.size(); i++)
+	{
+		const string& header = _computedHeader[i];
+
+		if (header == "" || header.length() != nameLength)
+			continue;
+
+		size_t j = 0;
+		while (j < header.length() && tolower((unsigned char) header[j]) == tolower((unsigned char) identifier[j]))
+			j++;
+
+		if (j == header.length())
+			return i;
+	}
+
+	return string::npos;
+}
+
+/*******************************************************************
+ * checkDoFinalPlan makes sure every parameter the compiled layout
+ * refers to has been configured. Parameters can be listed after the
+ * doFinalString line, so this runs once the whole file is parsed.
+ * Entries for the message body parameter are marked here, so the
+ * body can be hashed straight from the message.
+ ******************************************************************/
+
+bool signatureConfig::checkDoFinalPlan()
+{
+	if (_doFinalPlanError || _doFinalPlan.size() == 0)
+		return false;
+
+	for (size_t i = 0; i < _doFinalPlan.size(); i++)
+	{
+		if (_doFinalPlan[i].source == DOFINAL_PARSE && _doFinalPlan[i].index >= _parseParameter.size())
+			return false;
+		if (_doFinalPlan[i].source == DOFINAL_POST_PARSE && _doFinalPlan[i].index >= _postParseParameter.size())
+			return false;
+
+		if (_doFinalPlan[i].source == DOFINAL_PARSE && _parseParameter[_doFinalPlan[i].index]->getParameterIdentifier() == "[BCTt:message_body]")
+			_doFinalPlan[i].source = DOFINAL_BODY;
+
+		// a header that is computed is signed with its new value
+		if (_doFinalPlan[i].source == DOFINAL_PARSE)
+		{
+			size_t computed = findComputedHeader(_parseParameter[_doFinalPlan[i].index]->getParameterIdentifier());
+
+			if (computed != string::npos)
+			{
+				_doFinalPlan[i].source = DOFINAL_POST_PARSE;
+				_doFinalPlan[i].index = computed;
+			}
+		}
+	}
+
+	return true;
+}
+
+/****************************************************************
+ * getDoFinalParameter returns the parameter a layout entry uses
+ ***************************************************************/
+
+signingParameter* signatureConfig::getDoFinalParameter(const doFinalEntry& entry)
+{
+	if (entry.source == DOFINAL_POST_PARSE)
+		return _postParseParameter[entry.index];
+	else
+		return _parseParameter[entry.index];
 }
 
 /**********************************************************************
@@ -213,133 +753,312 @@ void signatureConfig::setSignatureParameter(string sigParameter)
  *******************************************************************/
 
 string signatureConfig::createSignature(char* tamperedMessagePath)
+{
+	mappedFile tamperedMessageFile;
+
+	if (!tamperedMessageFile.load(tamperedMessagePath))
+		return "ERROR";
+
+	signingMessage tamperedMessage(tamperedMessageFile.getData(), tamperedMessageFile.getSize());
+
+	return createSignature(tamperedMessage);
+}
+
+/********************************************************************
+ * createSignature(signingMessage&) signs an already indexed message.
+ * The old signature offset it records is an offset into that message.
+ * It returns "ERROR" if the config file is not parsed.
+ *******************************************************************/
+
+string signatureConfig::createSignature(signingMessage& tamperedMessage)
+{
+    if (buildSignature(tamperedMessage, true))
+        return _signature;
+    else
+        return "ERROR";
+}
+
+/********************************************************************
+ * signMessage signs an indexed message and records the new signature
+ * as an edit of the message, in place of the old one, along with a
+ * corrected Content-Length if the body length changed. The signed
+ * message can then be written out without copying it.
+ * The second form also copies the whole signed message into a buffer
+ * owned by the caller. Reusing that buffer means a batch of messages
+ * does not allocate per message.
+ * It returns false if the message could not be signed or has no
+ * signature to replace.
+ *******************************************************************/
+
+bool signatureConfig::signMessage(signingMessage& tamperedMessage)
+{
+    if (!buildSignature(tamperedMessage, true))
+        return false;
+
+    if (_oldSignatureOffset == string::npos)
+    {
+        cerr << "No signature found in the message!" << endl;
+        return false;
+    }
+
+    tamperedMessage.replace(_oldSignatureOffset, _oldSignature.length(), _signature);
+
+    // computed values go into their headers
+    for (size_t i = 0; i < _computedParameter.size(); i++)
+        if (_computedParameter[i] != NULL && _computedOffset[i] != string::npos)
+            tamperedMessage.replace(_computedOffset[i], _computedLength[i], _postParseParameter[i]->getParameterValue());
+
+    // the body may have been edited, so the length the server
+    // is told has to match what is actually sent
+    if (!tamperedMessage.fixContentLength())
+    {
+        cerr << "The chunked body was edited where its chunk sizes can not be corrected, not signing it!" << endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool signatureConfig::signMessage(signingMessage& tamperedMessage, string& signedMessage)
+{
+    if (!signMessage(tamperedMessage))
+        return false;
+
+    tamperedMessage.getEditedMessage(signedMessage);
+
+    return true;
+}
+
+/**********************************************************************
+ * lowerHexDigit lower-cases 'A' to 'F' and leaves every other byte as
+ * it is, without branching on the byte. (c - 'A') - 6 only borrows
+ * into the top bit for 'A' to 'F', or for bytes below 'A', which have
+ * the top bit of c - 'A' itself set.
+ *********************************************************************/
+
+static unsigned char lowerHexDigit(unsigned char c)
+{
+	unsigned int offset = (unsigned int) c - 'A';
+	unsigned int upper = ((offset - 6) & ~offset) >> 31;
+
+	return (unsigned char) (c | (upper << 5));
+}
+
+/**********************************************************************
+ * verifyMessage computes the signature of a captured message and
+ * compares it with the one the message carries, without changing the
+ * message. The comparison takes the same time wherever the signatures
+ * differ, and ignores the case of hex digits.
+ * matched is set to whether they are the same. It returns false if the
+ * message could not be signed or carries no signature.
+ *********************************************************************/
+
+bool signatureConfig::verifyMessage(signingMessage& capturedMessage, bool& matched)
+{
+    matched = false;
+
+    // computed headers are checked with the values the message carries
+    if (!buildSignature(capturedMessage, false))
+        return false;
+
+    if (_oldSignatureOffset == string::npos)
+    {
+        cerr << "No signature found in the message!" << endl;
+        return false;
+    }
+
+    bool hex = (_signatureAlgorithm.back()->getOutputEncoding() == "hex");
+
+    // only the lengths are compared early, they are no secret
+    if (_signature.length() != _oldSignature.length())
+        return true;
+
+    unsigned char difference = 0;
+
+    for (size_t i = 0; i < _signature.length(); i++)
+    {
+        unsigned char expected = (unsigned char) _signature[i];
+        unsigned char captured = (unsigned char) _oldSignature[i];
+
+        if (hex)
+        {
+            expected = lowerHexDigit(expected);
+            captured = lowerHexDigit(captured);
+        }
+
+        difference |= (unsigned char) (expected ^ captured);
+    }
+
+    matched = (difference == 0);
+
+    return true;
+}
+
+/********************************************************************
+ * buildSignature does the signing for createSignature,
+ * signMessage and verifyMessage, leaving the result in _signature.
+ * compute is false to sign with the computed headers as they are.
+ * It returns false if the config file is not parsed.
+ *******************************************************************/
+
+bool signatureConfig::buildSignature(signingMessage& tamperedMessage, bool compute)
 {
     if (!_error)
     {
-	size_t found = 0;
-	
-	ifstream tamperedMessage;
-	tamperedMessage.open(tamperedMessagePath);
-	
-	if (!tamperedMessage.is_open())
-		return NULL;
-	else
-	{
-            // parse out the data from the message needed to re-sign it.
+        const char* messageData = tamperedMessage.getData();
+        size_t valueOffset = 0;
+        size_t valueLength = 0;
+
+        // the same configuration may sign many messages,
+        // so nothing can be left over from the last one.
+        _oldSignature.clear();
+        _oldSignatureOffset = string::npos;
+
+        if (_stats != NULL)
+            _stats->startStage(signingStats::STAGE_EXTRACT);
 
-            string tempLineOrig = "";
-            string tempLine = "";
-            string parseParameter = "";
-            int counter = 0;
+        // pull out the data from the message needed to re-sign it.
 
-            while (!tamperedMessage.eof())
+        for (size_t i = 0; i < _parseParameter.size(); i++)
+        {
+            // the body is not copied, it is hashed straight from the message
+            if (_parseParameter[i]->getParameterIdentifier() == "[BCTt:message_body]")
+                continue;
+
+            if (tamperedMessage.findValue(_parseParameter[i]->getParameterIdentifier(), valueOffset, valueLength))
+                _parseParameter[i]->setParameterValue(messageData + valueOffset, valueLength);
+            else
+                _parseParameter[i]->setParameterValue(messageData, 0);
+        }
+
+        // computed parameters get a new value, or with compute false the
+        // value already in their header. Where the header is, is kept so
+        // the new value can be written into it. Without the header the
+        // value would be signed but never sent, so the message can not
+        // be signed at all.
+        for (size_t i = 0; i < _computedParameter.size(); i++)
+        {
+            if (_computedParameter[i] == NULL)
+                continue;
+
+            if (!tamperedMessage.findHeader(_computedHeader[i], valueOffset, valueLength))
             {
-                getline(tamperedMessage, tempLineOrig);
-                tempLine = tempLineOrig;
-
-                if (counter < _parseParameter.size())
-                {
-                    parseParameter = _parseParameter[counter]->getParameterIdentifier();
-                    found = tempLine.find(parseParameter);
-
-                    if (found < tempLine.length())
-                    {
-                        tempLine = tempLine.substr( found + parseParameter.length() );
-                        tempLine = tempLine.substr(0, (tempLine.length() - 1) );
-                        _parseParameter[counter]->setParameterValue(tempLine);
-                        counter++;
-                    }
-                }
-
-                found = tempLine.find(_signatureParameter);
-                if (found < tempLine.length())
-                {
-                    _oldSignature = tempLine.substr((found + _signatureParameter.length()));
-                    _oldSignature = _oldSignature.substr(0, (_oldSignature.length() - 1) );
-                }
-
-                // if it is time to include the message body, 
-                // loop through and get all of it
-
-                if (_parseParameter[counter]->getParameterIdentifier() == "[BCTt:message_body]")
-                {                            
-                    if (tempLineOrig == "\r")
-                    {
-                        cout << "Parsing Message Body" << endl;
-
-                        string messageBody = "";
-
-                        // hate having a second while loop,
-                        // but it saves code space and complexity
-                        while (!tamperedMessage.eof()) 
-                        {
-                            getline(tamperedMessage, tempLine);
-                            messageBody += tempLine;
-                        }
-
-                        _parseParameter[counter]->setParameterValue(messageBody);
-                        counter++;
-                    }
-                }
+                cerr << "The message has no " << _computedHeader[i] << " header for its computed value!" << endl;
+
+                if (_stats != NULL)
+                    _stats->endStage(signingStats::STAGE_EXTRACT);
+                return false;
             }
 
-            string tempDoFinal = _doFinalString;
-            string tempParameter = "";
-
-            // parse out the parameters in the doFinalString and 
-            // put their matching objects in an ordered vector for use.
-            int element = 0;
-
-            while (tempDoFinal.length() > 17)
-            {                    
-                found = tempDoFinal.find(".");
-
-                tempParameter = tempDoFinal.substr(0, found);
-                tempDoFinal = tempDoFinal.substr( (found + 1) );
-
-                if (tempParameter != "")
-                {
-                    found = tempParameter.find("postParseParameter-");
-
-                    if (found < tempParameter.length())
-                    {
-                        tempParameter = tempParameter.substr(19, 2);
-                        element = atoi(tempParameter.c_str());
-                        _doFinalVector.push_back(_postParseParameter[element]);
-                    }
-                    else
-                    {
-                        //parseParameter-
-                        tempParameter = tempParameter.substr(15, 2);
-                        element = atoi(tempParameter.c_str());
-                        _doFinalVector.push_back(_parseParameter[element]);
-                    }
-                }
+            _computedOffset[i] = valueOffset;
+            _computedLength[i] = valueLength;
+
+            if (compute)
+            {
+                const string& value = _computedParameter[i]->next();
+                _postParseParameter[i]->setParameterValue(value.data(), value.length());
             }
+            else
+                _postParseParameter[i]->setParameterValue(messageData + valueOffset, _computedLength[i]);
+        }
 
-            // form the final input to the algorithms
+        // remember where the signature sits in the message,
+        // so it can be replaced without searching for it again.
+        if (tamperedMessage.findValue(_signatureParameter, valueOffset, valueLength))
+        {
+            _oldSignature.assign(messageData + valueOffset, valueLength);
+            _oldSignatureOffset = valueOffset;
+        }
 
-            string digest = "";
+        const char* bodyData = NULL;
+        size_t bodyLength = 0;
 
-            for (int i = 0; i < _doFinalVector.size(); i++)
-                digest.append(_doFinalVector[i]->getParameterValue());
+        // a chunked body is signed as the chunks joined together
+        if (!tamperedMessage.getBody(bodyData, bodyLength))
+            cerr << "The chunked body does not add up, signing it as it is." << endl;
 
-            cout << "Final algorithm Input String: " << digest << endl;
+        if (_stats != NULL)
+        {
+            _stats->endStage(signingStats::STAGE_EXTRACT);
+            _stats->startStage(signingStats::STAGE_DIGEST);
+        }
 
-            // execute all algorithms. 
-            // Currently, we are assuming the algorithm only takes one input.
+        // feed the compiled layout straight into the first algorithm, piece
+        // by piece, so the input is never joined into one string. The body
+        // goes in straight from the message, line endings and all, so memory
+        // use does not grow with the size of the body. Only a chunked body
+        // is copied, to join its chunks.
 
-            for (int i = 0; i < _signatureAlgorithm.size(); i++)
+        bool verbose = !signingStats::isQuiet();
+
+        if (verbose)
+            cout << "Final algorithm Input String: ";
+
+        _signatureAlgorithm[0]->startDigest();
+
+        for (size_t i = 0; i < _doFinalPlan.size(); i++)
+        {
+            if (_doFinalPlan[i].source == DOFINAL_BODY)
             {
-                _signatureAlgorithm[i]->createDigest(digest);
-                digest = _signatureAlgorithm[i]->getDigest();
+                if (verbose)
+                    cout << "[BCTt:message_body]";
+
+                for (size_t chunk = 0; chunk < bodyLength; chunk += BODY_CHUNK_SIZE)
+                    _signatureAlgorithm[0]->updateDigest((const byte*) bodyData + chunk, min(BODY_CHUNK_SIZE, bodyLength - chunk));
             }
+            else
+            {
+                const string& value = (_doFinalPlan[i].source == DOFINAL_LITERAL) ? _doFinalPlan[i].literal : getDoFinalParameter(_doFinalPlan[i])->getParameterValue();
 
-            return digest;
-	}
+                if (verbose)
+                    cout << value;
+
+                _signatureAlgorithm[0]->updateDigest((const byte*) value.data(), value.length());
+            }
+        }
+
+        if (verbose)
+            cout << endl;
+
+        _signatureAlgorithm[0]->finishDigest();
+
+        // execute the rest of the algorithms.
+        // Currently, we are assuming the algorithm only takes one input.
+        // Each stage hands the next one a pointer to its raw or encoded
+        // output, so binary digests pass through intact.
+
+        const byte* stageData = NULL;
+        size_t stageLength = 0;
+
+        for (size_t i = 0; i < _signatureAlgorithm.size(); i++)
+        {
+            if (i > 0)
+                _signatureAlgorithm[i]->createDigest(stageData, stageLength);
+
+            if (_stats != NULL)
+            {
+                _stats->endStage(signingStats::STAGE_DIGEST);
+                _stats->startStage(signingStats::STAGE_ENCODE);
+            }
+
+            _signatureAlgorithm[i]->getOutput(stageData, stageLength);
+
+            if (_stats != NULL)
+            {
+                _stats->endStage(signingStats::STAGE_ENCODE);
+                _stats->startStage(signingStats::STAGE_DIGEST);
+            }
+        }
+
+        if (_stats != NULL)
+            _stats->endStage(signingStats::STAGE_DIGEST);
+
+        _signature.assign((const char*) stageData, stageLength);
+
+        return true;
     }
     else
-        return "ERROR";
+        return false;
 }
 
 /**********************************************************************
@@ -351,6 +1070,25 @@ string signatureConfig::getOldSignature()
 	return _oldSignature;
 }
 
+/**********************************************************************
+ * getSignature returns the signature made for the last message signed
+ *********************************************************************/
+
+string signatureConfig::getSignature()
+{
+	return _signature;
+}
+
+/*************************************************************************
+ * getOldSignatureOffset returns the byte offset of the old signature in
+ * the message file, or string::npos if no signature was found
+ ************************************************************************/
+
+size_t signatureConfig::getOldSignatureOffset()
+{
+	return _oldSignatureOffset;
+}
+
 /*************************************************************************
  * getSignatureParameter returns the value used to identify the signature
  * in the message
@@ -361,6 +1099,16 @@ string signatureConfig::getSignatureParameter()
 	return _signatureParameter;
 }
 
+/**************************************************************
+ * getError returns true if the configuration file could not be
+ * parsed into something that can sign a message
+ *************************************************************/
+
+bool signatureConfig::getError()
+{
+	return _error;
+}
+
 /***************************************************************
  * setTempFilePath allows the use of a custom location and name
  * for the temporary message file
@@ -380,3 +1128,13 @@ char* signatureConfig::getTempFilePath()
 {
 	return _tempFilePath;
 }
+
+/************************************************************
+ * setStats sets where the stages of each signing are timed,
+ * NULL to stop timing them
+ ***********************************************************/
+
+void signatureConfig::setStats(signingStats* stats)
+{
+	_stats = stats;
+}
@@ -17,6 +17,9 @@
 #include <fstream>
 #include "signatureAlgorithm.h"
 #include "signingParameter.h"
+#include "computedParameter.h"
+#include "signingMessage.h"
+#include "signingStats.h"
 
 using namespace std;
 
@@ -25,6 +28,7 @@ class signatureConfig
     public:
             signatureConfig();
             signatureConfig(char*);
+            signatureConfig(const signatureConfig&);
             ~signatureConfig();
 
             void setConfigFilePath(char*);
@@ -37,26 +41,65 @@ class signatureConfig
             void setSignatureParameter(string);
 
             string createSignature(char*);
+            string createSignature(signingMessage&);
+            bool signMessage(signingMessage&);
+            bool signMessage(signingMessage&, string&);
+            bool verifyMessage(signingMessage&, bool&);
             string getOldSignature();
+            string getSignature();
+            size_t getOldSignatureOffset();
             string getSignatureParameter();
+            bool getError();
 
             void setTempFilePath(char*);
             char* getTempFilePath();
+
+            void setStats(signingStats*);
 		
     private:
+            signatureConfig& operator=(const signatureConfig&);
+
+            // one step of the compiled doFinalString layout
+            enum doFinalSource { DOFINAL_PARSE, DOFINAL_POST_PARSE, DOFINAL_LITERAL, DOFINAL_BODY };
+
+            struct doFinalEntry
+            {
+                doFinalSource source;
+                size_t index;           // into the matching parameter list
+                string literal;         // only for DOFINAL_LITERAL
+            };
+
+            bool buildSignature(signingMessage&, bool);
+            void checkConfig();
+            bool checkComputedParameters();
+            size_t findComputedHeader(const string&);
+            bool checkDoFinalPlan();
+            void saveCompiledConfig(const char*, long long, long long, const string&);
+            bool loadCompiledConfig(const char*, long long, long long, const string&);
+            signingParameter* getDoFinalParameter(const doFinalEntry&);
+
             vector<signatureAlgorithm*> _signatureAlgorithm;
             vector<signingParameter*> _parseParameter;
             vector<signingParameter*> _postParseParameter;
-            vector<signingParameter*> _doFinalVector;
+            vector<doFinalEntry> _doFinalPlan;
+
+            // one entry per post parse parameter, NULL unless it is computed
+            vector<computedParameter*> _computedParameter;
+            vector<string> _computedHeader;     // "Name: " the value is written to
+            vector<size_t> _computedOffset;     // of that value in the message
+            vector<size_t> _computedLength;
 
             string _doFinalString;
+            bool _doFinalPlanError;
             string _signatureParameter;
             string _oldSignature;
+            string _signature;
+            size_t _oldSignatureOffset;
 
             char* _tempFilePath;
-            char* _configFilePath;
+            string _configFilePath;
 
-            ifstream _configFile;
+            signingStats* _stats;       // not owned, NULL when not timed
 
             bool _error;
 };
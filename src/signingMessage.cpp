@@ -0,0 +1,587 @@
+/**************************************************************************
+* File: signingMessage.cpp
+*
+* This provides the implementation for the message model.
+* The message data is not copied, it has to outlive the model.
+*
+* Author: Hon1nbo
+***************************************************************************/
+
+#include "signingMessage.h"
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+#include <cstdio>
+
+using namespace std;
+
+signingMessage::signingMessage()
+{
+    parse(NULL, 0);
+}
+
+signingMessage::signingMessage(const char* data, size_t size)
+{
+    parse(data, size);
+}
+
+signingMessage::~signingMessage()	{	}
+
+// header names are matched without regard to case, as in HTTP
+static void lowerCase(const char* text, size_t length, string& output)
+{
+    output.assign(text, length);
+
+    for (size_t i = 0; i < length; i++)
+        output[i] = (char) tolower((unsigned char) output[i]);
+}
+
+/*************************************************************************
+ * parse indexes the message in a single pass. Every line up to the first
+ * empty line is a header line, and is indexed by the name before its ':'.
+ * Everything after the empty line is the body.
+ ************************************************************************/
+
+void signingMessage::parse(const char* data, size_t size)
+{
+    _data = data;
+    _size = size;
+    _headerLines.clear();
+    _headerIndex.clear();
+    _bodyOffset = size;
+    _hasBody = false;
+    _chunked = false;
+    _bodyDecoded = false;
+    _bodyValid = true;
+    _editCount = 0;
+
+    size_t lineStart = 0;
+
+    while (lineStart < size)
+    {
+        const char* lineEnd = (const char*) memchr(data + lineStart, '\n', size - lineStart);
+        size_t nextLine = (lineEnd == NULL) ? size : (size_t) (lineEnd - data) + 1;
+
+        messageLine line;
+        line.offset = lineStart;
+        line.length = ((lineEnd == NULL) ? size : (size_t) (lineEnd - data)) - lineStart;
+
+        if (line.length > 0 && data[line.offset + line.length - 1] == '\r')
+            line.length--;
+
+        if (line.length == 0)
+        {
+            _bodyOffset = nextLine;
+            _hasBody = true;
+            break;
+        }
+
+        const char* colon = (const char*) memchr(data + line.offset, ':', line.length);
+
+        if (colon != NULL)
+        {
+            // the first header with a name wins, like the old line by line search
+            lowerCase(data + line.offset, (size_t) (colon - (data + line.offset)), _headerKey);
+            _headerIndex.insert(make_pair(_headerKey, _headerLines.size()));
+        }
+
+        _headerLines.push_back(line);
+        lineStart = nextLine;
+    }
+
+    // chunked has to be the last transfer coding if it is there at all
+    size_t valueOffset = 0;
+    size_t valueLength = 0;
+
+    if (findHeader("Transfer-Encoding", valueOffset, valueLength) && valueLength >= 7)
+    {
+        lowerCase(data + valueOffset + valueLength - 7, 7, _headerKey);
+        _chunked = (_headerKey == "chunked");
+    }
+}
+
+/*******************************************
+ * getData returns the start of the message
+ ******************************************/
+
+const char* signingMessage::getData()
+{
+    return _data;
+}
+
+/*******************************************
+ * getSize returns the length of the message
+ ******************************************/
+
+size_t signingMessage::getSize()
+{
+    return _size;
+}
+
+// the characters HTTP allows in a header name
+static bool isHeaderName(const char* text, size_t length)
+{
+    if (length == 0)
+        return false;
+
+    for (size_t i = 0; i < length; i++)
+        if (!isalnum((unsigned char) text[i]) && strchr("!#$%&'*+-.^_`|~", text[i]) == NULL)
+            return false;
+
+    return true;
+}
+
+/***************************************************************************
+ * findValue locates the value that follows an identifier such as
+ * "X-Message-Signature: ", up to the end of its line.
+ * An identifier that starts with a header name and a ':' is looked up
+ * among the headers by that name, in any case, and the rest of it has
+ * to match exactly. It is never matched inside another header line, so
+ * "Host: " can not find "X-Forwarded-Host: ". If there is no header by
+ * that name it is searched for in the body.
+ * Anything else, such as a JSON field name in quotes, is searched for
+ * in the whole message.
+ * It returns false if the identifier is not in the message, otherwise it
+ * sets the offset and length of the value.
+ **************************************************************************/
+
+bool signingMessage::findValue(const string& identifier, size_t& offset, size_t& length)
+{
+    if (identifier == "" || _data == NULL)
+        return false;
+
+    size_t found = identifier.find(':');
+    size_t searchFrom = 0;
+
+    if (found != string::npos && isHeaderName(identifier.data(), found))
+    {
+        lowerCase(identifier.data(), found, _headerKey);
+        unordered_map<string, size_t>::const_iterator header = _headerIndex.find(_headerKey);
+
+        if (header != _headerIndex.end())
+        {
+            const messageLine& line = _headerLines[header->second];
+
+            if (line.length < identifier.length() || memcmp(_data + line.offset + found,
+                    identifier.data() + found, identifier.length() - found) != 0)
+                return false;
+
+            offset = line.offset + identifier.length();
+            length = line.length - identifier.length();
+            return true;
+        }
+
+        searchFrom = _bodyOffset;
+    }
+
+    // not a header, fall back to a plain search
+    const char* end = _data + _size;
+    const char* match = search(_data + searchFrom, end, identifier.begin(), identifier.end());
+
+    if (match == end)
+        return false;
+
+    offset = (size_t) (match - _data) + identifier.length();
+
+    const char* lineEnd = (const char*) memchr(_data + offset, '\n', _size - offset);
+    length = ((lineEnd == NULL) ? _size : (size_t) (lineEnd - _data)) - offset;
+
+    if (length > 0 && _data[offset + length - 1] == '\r')
+        length--;
+
+    return true;
+}
+
+/********************************************************************
+ * getFirstLine sets the offset and length of the first line, which
+ * for an HTTP request is the request line, without its line ending.
+ * It returns false if the message has no header lines.
+ *******************************************************************/
+
+bool signingMessage::getFirstLine(size_t& offset, size_t& length)
+{
+    if (_headerLines.empty())
+        return false;
+
+    offset = _headerLines[0].offset;
+    length = _headerLines[0].length;
+
+    return true;
+}
+
+/****************************************************************************
+ * findHeader locates the value of a header by its name, in any case, with
+ * the white space around the value left out.
+ * It returns false if there is no such header, otherwise it sets the
+ * offset and length of the value.
+ ***************************************************************************/
+
+bool signingMessage::findHeader(const string& name, size_t& offset, size_t& length)
+{
+    lowerCase(name.data(), name.length(), _headerKey);
+
+    unordered_map<string, size_t>::const_iterator header = _headerIndex.find(_headerKey);
+
+    if (header == _headerIndex.end())
+        return false;
+
+    const messageLine& line = _headerLines[header->second];
+    size_t valueStart = line.offset + name.length() + 1;
+    size_t valueEnd = line.offset + line.length;
+
+    while (valueStart < valueEnd && (_data[valueStart] == ' ' || _data[valueStart] == '\t'))
+        valueStart++;
+
+    while (valueEnd > valueStart && (_data[valueEnd - 1] == ' ' || _data[valueEnd - 1] == '\t'))
+        valueEnd--;
+
+    offset = valueStart;
+    length = valueEnd - valueStart;
+
+    return true;
+}
+
+/*****************************************************************
+ * hasBody returns true if the message has an empty line ending
+ * its headers, even if nothing follows it
+ ****************************************************************/
+
+bool signingMessage::hasBody()
+{
+    return _hasBody;
+}
+
+/************************************************************
+ * getBodyOffset returns the offset of the message body, or
+ * the message size if there is no body
+ ***********************************************************/
+
+size_t signingMessage::getBodyOffset()
+{
+    return _bodyOffset;
+}
+
+/**********************************************************************
+ * isChunked returns true if the body is sent with chunked encoding
+ *********************************************************************/
+
+bool signingMessage::isChunked()
+{
+    return _chunked;
+}
+
+/*************************************************************************
+ * getBody points at the body as the receiver sees it. That is the bytes
+ * after the headers, or for a chunked body the chunks joined together.
+ * It returns false if a chunked body is malformed, in which case it
+ * points at the body as it is in the message.
+ ************************************************************************/
+
+bool signingMessage::getBody(const char*& body, size_t& length)
+{
+    if (_chunked && !_bodyDecoded)
+    {
+        _bodyValid = decodeChunkedBody();
+        _bodyDecoded = true;
+    }
+
+    if (_chunked && _bodyValid)
+    {
+        body = _decodedBody.data();
+        length = _decodedBody.length();
+    }
+    else
+    {
+        body = _data + _bodyOffset;
+        length = _size - _bodyOffset;
+    }
+
+    return _bodyValid;
+}
+
+/*************************************************************************
+ * decodeChunkedBody joins the chunks of the body into _decodedBody in one
+ * pass. Chunk extensions and trailers are skipped.
+ * It returns false if the chunks do not add up.
+ ************************************************************************/
+
+bool signingMessage::decodeChunkedBody()
+{
+    size_t position = _bodyOffset;
+
+    _decodedBody.clear();
+
+    while (position < _size)
+    {
+        const char* lineEnd = (const char*) memchr(_data + position, '\n', _size - position);
+
+        if (lineEnd == NULL)
+            return false;
+
+        size_t chunkSize = 0;
+        size_t digits = 0;
+
+        for (const char* c = _data + position; isxdigit((unsigned char) *c); c++, digits++)
+        {
+            if (chunkSize > (_size >> 4))
+                return false;
+
+            chunkSize = (chunkSize << 4) + (isdigit((unsigned char) *c) ? (*c - '0') : (tolower((unsigned char) *c) - 'a' + 10));
+        }
+
+        if (digits == 0)
+            return false;
+
+        position = (size_t) (lineEnd - _data) + 1;
+
+        if (chunkSize == 0)
+            return true;
+
+        if (_size - position < chunkSize)
+            return false;
+
+        _decodedBody.append(_data + position, chunkSize);
+        position += chunkSize;
+
+        // every chunk ends with its own line ending
+        if (position < _size && _data[position] == '\r')
+            position++;
+        if (position >= _size || _data[position] != '\n')
+            return false;
+        position++;
+    }
+
+    return false;
+}
+
+/*************************************************************************
+ * replace records that length bytes at offset are to be replaced by text
+ * when the message is written. Edits must not overlap.
+ ************************************************************************/
+
+void signingMessage::replace(size_t offset, size_t length, const string& text)
+{
+    if (_editCount == _edits.size())
+        _edits.push_back(messageEdit());
+
+    // keep the edits in offset order, there are only ever a few
+    size_t i = _editCount++;
+
+    while (i > 0 && _edits[i - 1].offset > offset)
+    {
+        _edits[i - 1].text.swap(_edits[i].text);
+        _edits[i].offset = _edits[i - 1].offset;
+        _edits[i].length = _edits[i - 1].length;
+        i--;
+    }
+
+    _edits[i].offset = offset;
+    _edits[i].length = length;
+    _edits[i].text.assign(text);
+}
+
+/*******************************************************
+ * getEditedSize returns the length of the edited message
+ ******************************************************/
+
+size_t signingMessage::getEditedSize()
+{
+    size_t size = _size;
+
+    for (size_t i = 0; i < _editCount; i++)
+        size = size - _edits[i].length + _edits[i].text.length();
+
+    return size;
+}
+
+/***************************************************************************
+ * write writes the edited message to a file, the unchanged parts straight
+ * from the original data.
+ * It returns false if the message could not be written.
+ **************************************************************************/
+
+bool signingMessage::write(FILE* output)
+{
+    size_t position = 0;
+
+    for (size_t i = 0; i < _editCount; i++)
+    {
+        const messageEdit& edit = _edits[i];
+
+        if (fwrite(_data + position, 1, edit.offset - position, output) != edit.offset - position)
+            return false;
+
+        if (fwrite(edit.text.data(), 1, edit.text.length(), output) != edit.text.length())
+            return false;
+
+        position = edit.offset + edit.length;
+    }
+
+    return (fwrite(_data + position, 1, _size - position, output) == _size - position);
+}
+
+/****************************************************************
+ * getEditedMessage copies the edited message into a buffer, for
+ * when it can not be written out yet
+ ***************************************************************/
+
+void signingMessage::getEditedMessage(string& editedMessage)
+{
+    size_t position = 0;
+
+    editedMessage.clear();
+    editedMessage.reserve(getEditedSize());
+
+    for (size_t i = 0; i < _editCount; i++)
+    {
+        const messageEdit& edit = _edits[i];
+
+        editedMessage.append(_data + position, edit.offset - position);
+        editedMessage.append(edit.text);
+        position = edit.offset + edit.length;
+    }
+
+    editedMessage.append(_data + position, _size - position);
+}
+
+/*************************************************************************
+ * fixContentLength records the edits that keep the framing of the body
+ * true to the body as it will be written, edits included. That is the
+ * Content-Length header, or for a chunked body the size line of every
+ * chunk whose length changes. Messages with neither are left alone.
+ * Call it after every other edit has been made.
+ * It returns false if a chunked body could not be framed again.
+ ************************************************************************/
+
+bool signingMessage::fixContentLength()
+{
+    size_t valueOffset = 0;
+    size_t valueLength = 0;
+
+    if (_chunked)
+        return fixChunkSizes();
+
+    if (!findHeader("Content-Length", valueOffset, valueLength))
+        return true;
+
+    size_t bodyLength = _size - _bodyOffset;
+
+    for (size_t i = 0; i < _editCount; i++)
+        if (_edits[i].offset >= _bodyOffset)
+            bodyLength = bodyLength - _edits[i].length + _edits[i].text.length();
+
+    char lengthText[32];
+    int lengthTextSize = sprintf(lengthText, "%lu", (unsigned long) bodyLength);
+
+    if (lengthTextSize == (int) valueLength && memcmp(lengthText, _data + valueOffset, valueLength) == 0)
+        return true;
+
+    replace(valueOffset, valueLength, string(lengthText, lengthTextSize));
+
+    return true;
+}
+
+/*************************************************************************
+ * fixChunkSizes rewrites the size line of every chunk that an edit makes
+ * longer or shorter, in the same case of hex digits. Edits that keep
+ * their length need nothing, and neither do edits in the trailers.
+ * It returns false if an edit that changes length is not inside the
+ * data of one chunk, or the chunks do not add up.
+ ************************************************************************/
+
+bool signingMessage::fixChunkSizes()
+{
+    vector<messageEdit> sizeEdits;
+    size_t position = _bodyOffset;
+    size_t i = 0;
+
+    while (i < _editCount && _edits[i].offset < _bodyOffset)
+        i++;
+
+    while (position < _size)
+    {
+        const char* lineEnd = (const char*) memchr(_data + position, '\n', _size - position);
+
+        if (lineEnd == NULL)
+            break;
+
+        size_t chunkSize = 0;
+        size_t digits = 0;
+        bool upperCase = false;
+
+        for (const char* c = _data + position; isxdigit((unsigned char) *c); c++, digits++)
+        {
+            if (chunkSize > (_size >> 4))
+                return false;
+
+            upperCase = upperCase || isupper((unsigned char) *c);
+            chunkSize = (chunkSize << 4) + (isdigit((unsigned char) *c) ? (*c - '0') : (tolower((unsigned char) *c) - 'a' + 10));
+        }
+
+        if (digits == 0)
+            break;
+
+        size_t sizeOffset = position;
+        size_t dataOffset = (size_t) (lineEnd - _data) + 1;
+
+        // the rest is the last chunk and the trailers
+        if (chunkSize == 0)
+        {
+            for (; i < _editCount && _edits[i].offset < dataOffset; i++)
+                if (_edits[i].length != _edits[i].text.length())
+                    return false;
+
+            i = _editCount;
+            break;
+        }
+
+        if (_size - dataOffset < chunkSize)
+            break;
+
+        size_t dataEnd = dataOffset + chunkSize;
+
+        position = dataEnd;
+
+        if (position < _size && _data[position] == '\r')
+            position++;
+        if (position >= _size || _data[position] != '\n')
+            break;
+        position++;
+
+        size_t newChunkSize = chunkSize;
+
+        for (; i < _editCount && _edits[i].offset < position; i++)
+        {
+            const messageEdit& edit = _edits[i];
+
+            if (edit.length == edit.text.length())
+                continue;
+
+            if (edit.offset < dataOffset || edit.offset + edit.length > dataEnd)
+                return false;
+
+            newChunkSize = newChunkSize - edit.length + edit.text.length();
+        }
+
+        if (newChunkSize != chunkSize)
+        {
+            char sizeText[32];
+            int sizeTextSize = sprintf(sizeText, upperCase ? "%lX" : "%lx", (unsigned long) newChunkSize);
+
+            sizeEdits.push_back(messageEdit());
+            sizeEdits.back().offset = sizeOffset;
+            sizeEdits.back().length = digits;
+            sizeEdits.back().text.assign(sizeText, sizeTextSize);
+        }
+    }
+
+    // a body whose chunks do not add up can only be sent as it is
+    for (; i < _editCount; i++)
+        if (_edits[i].length != _edits[i].text.length())
+            return false;
+
+    for (size_t j = 0; j < sizeEdits.size(); j++)
+        replace(sizeEdits[j].offset, sizeEdits[j].length, sizeEdits[j].text);
+
+    return true;
+}
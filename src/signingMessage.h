@@ -0,0 +1,98 @@
+/**************************************************************************
+* File: signingMessage.h
+*
+* This provides the interface for the message model.
+* A message is indexed once into its header lines and body, and the
+* values needed for signing are handed out as byte offsets into the
+* original data, so finding a parameter and replacing the signature
+* both work from the same parse.
+* Changes such as the new signature are kept as a list of edits, and
+* the edited message is written out piece by piece around them instead
+* of being copied into one buffer first.
+* It understands enough HTTP/1.1 to find header values by name without
+* regard to case, to hand out a chunked body de-chunked, and to correct
+* Content-Length, or the chunk sizes, after the body has been edited.
+*
+* Author: Hon1nbo
+***************************************************************************/
+
+#ifndef signingMessage_h
+#define signingMessage_h
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdio>
+
+using namespace std;
+
+class signingMessage
+{
+    public:
+            signingMessage();
+            signingMessage(const char*, size_t);
+            ~signingMessage();
+
+            void parse(const char*, size_t);
+
+            const char* getData();
+            size_t getSize();
+
+            bool findValue(const string&, size_t&, size_t&);
+            bool getFirstLine(size_t&, size_t&);
+
+            bool findHeader(const string&, size_t&, size_t&);
+
+            bool hasBody();
+            size_t getBodyOffset();
+            bool isChunked();
+            bool getBody(const char*&, size_t&);
+
+            void replace(size_t, size_t, const string&);
+            size_t getEditedSize();
+            bool write(FILE*);
+            void getEditedMessage(string&);
+            bool fixContentLength();
+
+    private:
+            struct messageLine
+            {
+                size_t offset;
+                size_t length;      // without the line ending
+            };
+
+            struct messageEdit
+            {
+                size_t offset;
+                size_t length;      // of the original bytes replaced
+                string text;
+            };
+
+            const char* _data;
+            size_t _size;
+
+            bool decodeChunkedBody();
+            bool fixChunkSizes();
+
+            vector<messageLine> _headerLines;
+            unordered_map<string, size_t> _headerIndex;     // by lower case name
+            string _headerKey;                              // reused for lookups
+
+            size_t _bodyOffset;
+            bool _hasBody;
+            bool _chunked;
+
+            // a chunked body is only decoded when asked for, into a
+            // buffer that keeps its memory from one message to the next
+            string _decodedBody;
+            bool _bodyDecoded;
+            bool _bodyValid;
+
+            // kept in offset order, the first _editCount are in use so the
+            // strings keep their memory from one message to the next
+            vector<messageEdit> _edits;
+            size_t _editCount;
+};
+
+#endif
@@ -47,7 +47,7 @@ void signingParameter::setParameterIdentifier(string parameterIdentifier)
  * a signing parameter
  ***********************************************************/
 
-string signingParameter::getParameterIdentifier()
+const string& signingParameter::getParameterIdentifier()
 {
 	return _parameterIdentifier;
 }
@@ -62,12 +62,22 @@ void signingParameter::setParameterValue(string parameterValue)
 	_parameterValue = parameterValue;
 }
 
+/***********************************************************************
+ * setParameterValue(const char*, size_t) copies a value straight out of
+ * the message into the existing buffer, so no new string is made
+ **********************************************************************/
+
+void signingParameter::setParameterValue(const char* parameterValue, size_t length)
+{
+	_parameterValue.assign(parameterValue, length);
+}
+
 /***********************************************************************
  * getParameterValue returns a string containing the stored value for a 
  * signing parameter
  **********************************************************************/
 
-string signingParameter::getParameterValue()
+const string& signingParameter::getParameterValue()
 {
 	return _parameterValue;
 }
@@ -25,10 +25,11 @@ class signingParameter
 		~signingParameter();
 		
 		void setParameterIdentifier(string);
-		string getParameterIdentifier();
+		const string& getParameterIdentifier();
 		
 		void setParameterValue(string);
-		string getParameterValue();
+		void setParameterValue(const char*, size_t);
+		const string& getParameterValue();
 
 	private:
 		string _parameterIdentifier;
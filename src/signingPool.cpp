@@ -0,0 +1,141 @@
+/**************************************************************************
+* File: signingPool.cpp
+*
+* This provides the implementation for the work-stealing thread pool.
+* Blocks are dealt out round robin before the workers start and no work
+* is added later, so a worker that finds every queue empty is done.
+*
+* Author: Hon1nbo
+***************************************************************************/
+
+#include "signingPool.h"
+#include <thread>
+
+using namespace std;
+
+// small enough to balance the load, large enough to keep the locks cold
+static const size_t BLOCK_SIZE = 64;
+
+signingPool::signingPool(unsigned int threadCount)
+{
+    _threadCount = (threadCount == 0) ? getDefaultThreadCount() : threadCount;
+    _taskCount = 0;
+    _task = NULL;
+    _context = NULL;
+
+    for (unsigned int i = 0; i < _threadCount; i++)
+        _queues.push_back(new workQueue());
+}
+
+signingPool::~signingPool()
+{
+    for (unsigned int i = 0; i < _queues.size(); i++)
+        delete _queues[i];
+}
+
+/************************************************************
+ * getDefaultThreadCount returns the number of cores, or 1
+ * if it can not be found
+ ***********************************************************/
+
+unsigned int signingPool::getDefaultThreadCount()
+{
+    unsigned int cores = thread::hardware_concurrency();
+    return (cores == 0) ? 1 : cores;
+}
+
+/**********************************************
+ * getThreadCount returns the number of workers
+ *********************************************/
+
+unsigned int signingPool::getThreadCount()
+{
+    return _threadCount;
+}
+
+/**************************************************************************
+ * run calls task(context, worker, n) for every n from 0 to taskCount - 1
+ * and returns once all of them are finished. worker is the number of the
+ * thread, from 0 to getThreadCount() - 1, so the caller can keep state
+ * for each thread. With one thread everything runs on the calling thread.
+ *************************************************************************/
+
+void signingPool::run(size_t taskCount, signingTask task, void* context)
+{
+    _taskCount = taskCount;
+    _task = task;
+    _context = context;
+
+    for (size_t block = 0, i = 0; block < taskCount; block += BLOCK_SIZE, i++)
+        _queues[i % _threadCount]->blocks.push_back(block);
+
+    if (_threadCount == 1)
+    {
+        work(0);
+        return;
+    }
+
+    vector<thread> workers;
+
+    for (unsigned int i = 1; i < _threadCount; i++)
+        workers.push_back(thread(&signingPool::work, this, i));
+
+    work(0);
+
+    for (unsigned int i = 0; i < workers.size(); i++)
+        workers[i].join();
+}
+
+/**************************************************************
+ * work runs blocks of tasks until there are none left anywhere
+ *************************************************************/
+
+void signingPool::work(unsigned int worker)
+{
+    size_t block = 0;
+
+    while (takeBlock(worker, block))
+    {
+        size_t blockEnd = block + BLOCK_SIZE;
+        if (blockEnd > _taskCount)
+            blockEnd = _taskCount;
+
+        for (size_t i = block; i < blockEnd; i++)
+            _task(_context, worker, i);
+    }
+}
+
+/*************************************************************************
+ * takeBlock takes the next block from the worker's own queue, or steals
+ * the last block of another worker's queue.
+ * It returns false once every queue is empty.
+ ************************************************************************/
+
+bool signingPool::takeBlock(unsigned int worker, size_t& block)
+{
+    {
+        lock_guard<mutex> guard(_queues[worker]->lock);
+
+        if (!_queues[worker]->blocks.empty())
+        {
+            block = _queues[worker]->blocks.front();
+            _queues[worker]->blocks.pop_front();
+            return true;
+        }
+    }
+
+    for (unsigned int i = 1; i < _threadCount; i++)
+    {
+        workQueue* victim = _queues[(worker + i) % _threadCount];
+        lock_guard<mutex> guard(victim->lock);
+
+        if (!victim->blocks.empty())
+        {
+            block = victim->blocks.back();
+            victim->blocks.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,55 @@
+/**************************************************************************
+* File: signingPool.h
+*
+* This provides the interface for the work-stealing thread pool used to
+* spread a batch of messages over every core.
+* Tasks are numbered 0 to n-1 and handed out in blocks. Each worker has
+* its own queue of blocks, takes the lowest block from its own queue,
+* and when that runs dry steals the highest block from another worker,
+* so the batch still finishes close to input order.
+*
+* Author: Hon1nbo
+***************************************************************************/
+
+#ifndef signingPool_h
+#define signingPool_h
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+#include <mutex>
+
+using namespace std;
+
+// called once per task, on the worker thread that took it
+typedef void (*signingTask)(void*, unsigned int, size_t);
+
+class signingPool
+{
+    public:
+            signingPool(unsigned int);
+            ~signingPool();
+
+            unsigned int getThreadCount();
+            void run(size_t, signingTask, void*);
+
+            static unsigned int getDefaultThreadCount();
+
+    private:
+            struct workQueue
+            {
+                mutex lock;
+                deque<size_t> blocks;   // first task of each block
+            };
+
+            void work(unsigned int);
+            bool takeBlock(unsigned int, size_t&);
+
+            unsigned int _threadCount;
+            size_t _taskCount;
+            signingTask _task;
+            void* _context;
+            vector<workQueue*> _queues;
+};
+
+#endif
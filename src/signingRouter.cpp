@@ -0,0 +1,443 @@
+/**************************************************************************
+* File: signingRouter.cpp
+*
+* This provides the implementation for choosing a signing profile per
+* message. A routes file holds one line per route:
+*
+*   route:METHOD HOST PATH-PREFIX CONFIG-FILE
+*
+* METHOD and HOST may be * to match anything, and PATH-PREFIX may be *
+* to match every path. CONFIG-FILE is relative to the routes file.
+* The longest matching path prefix wins, then the exact method over *,
+* and a route for the exact host is tried before the routes for *.
+*
+* Author: Hon1nbo
+***************************************************************************/
+
+#include "signingRouter.h"
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <cctype>
+
+using namespace std;
+
+signingRouter::signingRouter()
+{
+    _routed = false;
+    _error = false;
+}
+
+/*********************************************************************
+ * the copy constructor makes its own copy of every profile, so each
+ * signing thread can route and sign without sharing hash objects
+ ********************************************************************/
+
+signingRouter::signingRouter(const signingRouter& other)
+{
+    _profilePaths = other._profilePaths;
+    _tries = other._tries;
+    _hosts = other._hosts;
+    _routed = other._routed;
+    _error = other._error;
+
+    for (size_t i = 0; i < other._profiles.size(); i++)
+    {
+        _profiles.push_back(new signatureConfig(*other._profiles[i]));
+        _profiles.back()->setStats(&_stats);
+    }
+}
+
+signingRouter::~signingRouter()
+{
+    for (size_t i = 0; i < _profiles.size(); i++)
+        delete _profiles[i];
+}
+
+/*************************************************************************
+ * load reads a routes file, or a plain configuration file to be used for
+ * every message. A file with any route: line is a routes file.
+ * It returns false if the file, or any profile it names, can not be used.
+ ************************************************************************/
+
+bool signingRouter::load(string filePath)
+{
+    // charged to the first message signed afterwards
+    _stats.startStage(signingStats::STAGE_CONFIG);
+
+    bool loaded = loadFile(filePath);
+
+    _stats.endStage(signingStats::STAGE_CONFIG);
+
+    return loaded;
+}
+
+/*************************************************************
+ * loadFile tells a routes file from a configuration file and
+ * loads it
+ ************************************************************/
+
+bool signingRouter::loadFile(string filePath)
+{
+    ifstream routesFile(filePath.c_str());
+    string line = "";
+    bool routes = false;
+
+    while (!routes && getline(routesFile, line))
+        routes = (line.compare(0, 6, "route:") == 0);
+
+    routesFile.close();
+
+    if (routes)
+        return loadRoutes(filePath);
+
+    _routed = false;
+    addProfile(filePath);
+
+    return !_error;
+}
+
+/***********************************************************
+ * loadRoutes compiles every route in a routes file, parsing
+ * each configuration file it names once
+ **********************************************************/
+
+bool signingRouter::loadRoutes(string filePath)
+{
+    ifstream routesFile(filePath.c_str());
+
+    if (!routesFile.is_open())
+    {
+        cerr << "Could not open the routes file!" << endl;
+        _error = true;
+        return false;
+    }
+
+#ifdef _WIN32
+    size_t found = filePath.find_last_of("/\\");
+#else
+    size_t found = filePath.find_last_of('/');
+#endif
+    string routesDirectory = (found == string::npos) ? "" : filePath.substr(0, found + 1);
+
+    _routed = true;
+
+    string line = "";
+
+    while (getline(routesFile, line))
+    {
+        if (line.compare(0, 6, "route:") != 0)
+            continue;
+
+        line = line.substr(6);
+
+        if (line.length() > 0 && line[line.length() - 1] == '\r')
+            line = line.substr(0, (line.length() - 1));
+
+        // METHOD HOST PATH-PREFIX, then the rest of the line is the file
+        string field[3];
+        size_t position = 0;
+
+        for (int i = 0; i < 3; i++)
+        {
+            size_t fieldEnd = line.find(' ', position);
+
+            if (fieldEnd == string::npos)
+            {
+                position = string::npos;
+                break;
+            }
+
+            field[i] = line.substr(position, fieldEnd - position);
+            position = fieldEnd + 1;
+        }
+
+        if (position == string::npos || position >= line.length())
+        {
+            cerr << "Bad route: " << line << endl;
+            _error = true;
+            continue;
+        }
+
+        string configFilePath = line.substr(position);
+
+#ifdef _WIN32
+        bool absolute = (configFilePath[0] == '/' || configFilePath[0] == '\\' || (configFilePath.length() > 1 && configFilePath[1] == ':'));
+#else
+        bool absolute = (configFilePath[0] == '/');
+#endif
+        if (!absolute)
+            configFilePath = routesDirectory + configFilePath;
+
+        addRoute(field[0], field[1], field[2], addProfile(configFilePath));
+    }
+
+    routesFile.close();
+
+    if (_profiles.empty())
+    {
+        cerr << "No routes in " << filePath << endl;
+        _error = true;
+    }
+
+    return !_error;
+}
+
+/*************************************************************************
+ * addProfile parses a configuration file as a profile, or finds it if it
+ * has been added already, and returns its number
+ ************************************************************************/
+
+size_t signingRouter::addProfile(string configFilePath)
+{
+    for (size_t i = 0; i < _profilePaths.size(); i++)
+        if (_profilePaths[i] == configFilePath)
+            return i;
+
+    _profilePaths.push_back(configFilePath);
+
+    signatureConfig* profile = new signatureConfig();
+    profile->setConfigFilePath((char*) configFilePath.c_str());
+    profile->setStats(&_stats);
+    profile->parseConfigFile();
+
+    if (profile->getError())
+    {
+        cerr << "Could not load the profile " << configFilePath << endl;
+        _error = true;
+    }
+
+    _profiles.push_back(profile);
+
+    return _profiles.size() - 1;
+}
+
+/*************************************************************************
+ * addRoute sends messages for method, host and path prefix to a profile.
+ * Hosts are matched without their case or port.
+ ************************************************************************/
+
+void signingRouter::addRoute(string method, string host, string pathPrefix, size_t profile)
+{
+    for (size_t i = 0; i < host.length(); i++)
+        host[i] = (char) tolower((unsigned char) host[i]);
+
+    if (pathPrefix == "*")
+        pathPrefix = "";
+
+    unordered_map<string, size_t>::iterator hostRoutes = _hosts.find(host);
+
+    if (hostRoutes == _hosts.end())
+    {
+        hostRoutes = _hosts.insert(make_pair(host, _tries.size())).first;
+        _tries.push_back(routeTrie());
+        _tries.back().nodes.push_back(routeNode());
+    }
+
+    routeTrie& trie = _tries[hostRoutes->second];
+    size_t node = 0;
+
+    for (size_t i = 0; i < pathPrefix.length(); i++)
+    {
+        size_t next = 0;
+
+        while (next < trie.nodes[node].edgeBytes.size() && trie.nodes[node].edgeBytes[next] != pathPrefix[i])
+            next++;
+
+        if (next == trie.nodes[node].edgeBytes.size())
+        {
+            trie.nodes[node].edgeBytes.push_back(pathPrefix[i]);
+            trie.nodes[node].edgeNodes.push_back(trie.nodes.size());
+            trie.nodes.push_back(routeNode());
+        }
+
+        node = trie.nodes[node].edgeNodes[next];
+    }
+
+    routeNode& end = trie.nodes[node];
+
+    for (size_t i = 0; i < end.methods.size(); i++)
+    {
+        if (end.methods[i] == method)
+        {
+            end.profiles[i] = profile;
+            return;
+        }
+    }
+
+    end.methods.push_back(method);
+    end.profiles.push_back(profile);
+}
+
+/****************************************************************************
+ * route picks the profile for a message from its request line, taking the
+ * host from an absolute URL there or else from the Host header.
+ * It returns NULL if no route matches, or the profile if there are no routes.
+ ***************************************************************************/
+
+signatureConfig* signingRouter::route(signingMessage& message)
+{
+    if (!_routed)
+        return _profiles.empty() ? NULL : _profiles[0];
+
+    size_t lineOffset = 0;
+    size_t lineLength = 0;
+
+    if (!message.getFirstLine(lineOffset, lineLength))
+        return NULL;
+
+    // METHOD SP TARGET SP VERSION
+    const char* line = message.getData() + lineOffset;
+    const char* lineEnd = line + lineLength;
+    const char* methodEnd = (const char*) memchr(line, ' ', lineLength);
+
+    if (methodEnd == NULL)
+        return NULL;
+
+    const char* path = methodEnd + 1;
+    const char* pathEnd = (const char*) memchr(path, ' ', lineEnd - path);
+
+    if (pathEnd == NULL)
+        pathEnd = lineEnd;
+
+    const char* host = NULL;
+    const char* hostEnd = NULL;
+
+    if ((size_t) (pathEnd - path) > 7 && (memcmp(path, "http://", 7) == 0 || memcmp(path, "https://", 8) == 0))
+    {
+        host = path + ((path[4] == 's') ? 8 : 7);
+        hostEnd = (const char*) memchr(host, '/', pathEnd - host);
+
+        if (hostEnd == NULL)
+            hostEnd = pathEnd;
+
+        path = hostEnd;
+    }
+    else
+    {
+        size_t valueOffset = 0;
+        size_t valueLength = 0;
+
+        if (message.findHeader("Host", valueOffset, valueLength))
+        {
+            host = message.getData() + valueOffset;
+            hostEnd = host + valueLength;
+        }
+    }
+
+    // hosts are looked up in lower case and without the port
+    _hostKey.clear();
+
+    for (const char* c = host; c != NULL && c < hostEnd; c++)
+        _hostKey += (char) tolower((unsigned char) *c);
+
+    size_t portStart = _hostKey.rfind(':');
+    if (portStart != string::npos && _hostKey.find(']', portStart) == string::npos)
+        _hostKey.erase(portStart);
+
+    size_t methodLength = methodEnd - line;
+    size_t pathLength = pathEnd - path;
+    size_t profile = 0;
+
+    unordered_map<string, size_t>::const_iterator hostRoutes = _hosts.find(_hostKey);
+
+    if (hostRoutes != _hosts.end() && matchPath(_tries[hostRoutes->second], line, methodLength, path, pathLength, profile))
+        return _profiles[profile];
+
+    _hostKey = "*";
+    hostRoutes = _hosts.find(_hostKey);
+
+    if (hostRoutes != _hosts.end() && matchPath(_tries[hostRoutes->second], line, methodLength, path, pathLength, profile))
+        return _profiles[profile];
+
+    return NULL;
+}
+
+/*************************************************************************
+ * matchPath walks a host's trie down the path, remembering the profile
+ * of the longest prefix routed for the method.
+ * It returns false if no prefix of the path is routed for the method.
+ ************************************************************************/
+
+bool signingRouter::matchPath(const routeTrie& trie, const char* method, size_t methodLength, const char* path, size_t pathLength, size_t& profile)
+{
+    bool matched = false;
+    size_t node = 0;
+    size_t i = 0;
+
+    while (true)
+    {
+        const routeNode& current = trie.nodes[node];
+
+        for (size_t j = 0; j < current.methods.size(); j++)
+        {
+            const string& routeMethod = current.methods[j];
+
+            if (routeMethod.length() == methodLength && memcmp(routeMethod.data(), method, methodLength) == 0)
+            {
+                profile = current.profiles[j];
+                matched = true;
+                break;
+            }
+
+            if (routeMethod == "*")
+            {
+                profile = current.profiles[j];
+                matched = true;
+            }
+        }
+
+        if (i == pathLength)
+            break;
+
+        size_t next = 0;
+
+        while (next < current.edgeBytes.size() && current.edgeBytes[next] != path[i])
+            next++;
+
+        if (next == current.edgeBytes.size())
+            break;
+
+        node = current.edgeNodes[next];
+        i++;
+    }
+
+    return matched;
+}
+
+/**********************************************
+ * getProfileCount returns the number of profiles
+ *********************************************/
+
+size_t signingRouter::getProfileCount()
+{
+    return _profiles.size();
+}
+
+/*****************************************************************
+ * getProfilePaths returns the configuration file of each profile,
+ * including any that failed to load
+ ****************************************************************/
+
+const vector<string>& signingRouter::getProfilePaths()
+{
+    return _profilePaths;
+}
+
+/*******************************************************************
+ * getError returns true if the routes or any profile failed to load
+ ******************************************************************/
+
+bool signingRouter::getError()
+{
+    return _error;
+}
+
+/**************************************************************
+ * getStats returns the timings of the signings routed here
+ *************************************************************/
+
+signingStats& signingRouter::getStats()
+{
+    return _stats;
+}
@@ -0,0 +1,85 @@
+/**************************************************************************
+* File: signingRouter.h
+*
+* This provides the interface for choosing a signing profile per message.
+* A profile is one parsed signatureConfig. The router is loaded from
+* either a plain configuration file, which is then used for every
+* message, or a routes file naming a profile for each method, host and
+* path prefix.
+* Routes are compiled into a hash table of hosts, each holding a trie of
+* path prefixes, so a message is routed with one hash lookup and one
+* walk down its path, however many profiles there are.
+* Every router times its own signings, so each signing thread, which
+* has its own copy of the router, also has its own signingStats.
+*
+* Author: Hon1nbo
+***************************************************************************/
+
+#ifndef signingRouter_h
+#define signingRouter_h
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "signatureConfig.h"
+#include "signingMessage.h"
+#include "signingStats.h"
+
+using namespace std;
+
+class signingRouter
+{
+    public:
+            signingRouter();
+            signingRouter(const signingRouter&);
+            ~signingRouter();
+
+            bool load(string);
+
+            size_t addProfile(string);
+            void addRoute(string, string, string, size_t);
+
+            signatureConfig* route(signingMessage&);
+
+            size_t getProfileCount();
+            const vector<string>& getProfilePaths();
+            bool getError();
+
+            signingStats& getStats();
+
+    private:
+            signingRouter& operator=(const signingRouter&);
+
+            // one byte of a path prefix, and what ends there
+            struct routeNode
+            {
+                vector<char> edgeBytes;
+                vector<size_t> edgeNodes;
+                vector<string> methods;     // "*" matches any method
+                vector<size_t> profiles;
+            };
+
+            // every path prefix routed for one host
+            struct routeTrie
+            {
+                vector<routeNode> nodes;    // nodes[0] is the empty prefix
+            };
+
+            bool loadFile(string);
+            bool loadRoutes(string);
+            bool matchPath(const routeTrie&, const char*, size_t, const char*, size_t, size_t&);
+
+            vector<signatureConfig*> _profiles;
+            vector<string> _profilePaths;
+
+            vector<routeTrie> _tries;
+            unordered_map<string, size_t> _hosts;   // "*" is any host
+            bool _routed;                           // false: profile 0 for everything
+
+            string _hostKey;        // reused for every lookup
+            bool _error;
+
+            signingStats _stats;
+};
+
+#endif
@@ -0,0 +1,446 @@
+/**************************************************************************
+* File: signingServer.cpp
+*
+* This provides the implementation for the long-running signing server.
+* Requests are a single line holding the full path of the message file,
+* and the server answers with a single "OK" or "ERROR" line once the
+* message has been re-signed in place.
+* The server signs with keys only its user should use, so the socket
+* lives in a directory private to that user, and only clients running
+* as the same user are served.
+*
+* Author: Hon1nbo
+***************************************************************************/
+
+#include "signingServer.h"
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+
+#ifdef _WIN32
+        #include "windows.h"
+#else
+        #include <sys/types.h>
+        #include <sys/stat.h>
+        #include <sys/socket.h>
+        #include <sys/time.h>
+        #include <sys/un.h>
+        #include <unistd.h>
+        #include <signal.h>
+#endif
+
+using namespace std;
+
+// a client sending this instead of a path shuts the server down
+static const string SHUTDOWN_REQUEST = "[BCTt:shutdown]";
+static const size_t MAX_REQUEST_LENGTH = 4096;
+
+// how long a client may take to send its request, so one that never
+// does can not hold up everyone else
+static const int CLIENT_TIMEOUT_SECONDS = 5;
+
+signingServer::signingServer(configWatcher* configs, signingHandler handler)
+{
+    _configs = configs;
+    _handler = handler;
+    _endpoint = getDefaultEndpoint();
+    _running = false;
+}
+
+signingServer::~signingServer()	{	}
+
+/******************************************************************
+ * setEndpoint sets the socket path (or pipe name) to listen on,
+ * an empty string keeps the default
+ *****************************************************************/
+
+void signingServer::setEndpoint(string endpoint)
+{
+    if (endpoint != "")
+        _endpoint = endpoint;
+}
+
+/**************************************************************
+ * getEndpoint returns the socket path or pipe name in use
+ *************************************************************/
+
+string signingServer::getEndpoint()
+{
+    return _endpoint;
+}
+
+/**************************************************************
+ * stop makes the server return after the current request
+ *************************************************************/
+
+void signingServer::stop()
+{
+    _running = false;
+}
+
+/*********************************************************************
+ * handleRequest signs the message named by a request line.
+ * It returns true if the message was re-signed successfully.
+ ********************************************************************/
+
+bool signingServer::handleRequest(string request)
+{
+    if (request.length() > 0 && request[request.length() - 1] == '\r')
+        request = request.substr(0, (request.length() - 1));
+
+    if (request == SHUTDOWN_REQUEST)
+    {
+        stop();
+        return true;
+    }
+
+    if (request == "")
+        return false;
+
+    // hold on to the profiles for the whole request,
+    // a reload in the meantime only affects the next one
+    shared_ptr<signingRouter> router = _configs->getConfig();
+
+    return _handler(*router, (char*) request.c_str());
+}
+
+#ifdef _WIN32
+
+/**************************************************************
+ * getDefaultEndpoint returns the pipe name used if none is set
+ *************************************************************/
+
+string signingServer::getDefaultEndpoint()
+{
+    return BCTT_DEFAULT_ENDPOINT;
+}
+
+/*********************************************************************
+ * run listens on a named pipe and serves requests one at a time
+ * until a shutdown request is received.
+ * It returns false if the pipe could not be created.
+ ********************************************************************/
+
+bool signingServer::run()
+{
+    _running = true;
+
+    while (_running)
+    {
+        HANDLE pipe = CreateNamedPipeA(_endpoint.c_str(), PIPE_ACCESS_DUPLEX,
+                PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                PIPE_UNLIMITED_INSTANCES, MAX_REQUEST_LENGTH, MAX_REQUEST_LENGTH, 0, NULL);
+
+        if (pipe == INVALID_HANDLE_VALUE)
+        {
+            cerr << "Could not create the signing pipe!" << endl;
+            return false;
+        }
+
+        if (ConnectNamedPipe(pipe, NULL) || GetLastError() == ERROR_PIPE_CONNECTED)
+        {
+            string request = "";
+            char buffer[256];
+            DWORD bytesRead = 0;
+
+            while (request.find('\n') == string::npos && request.length() < MAX_REQUEST_LENGTH
+                    && ReadFile(pipe, buffer, sizeof(buffer), &bytesRead, NULL) && bytesRead > 0)
+                request.append(buffer, bytesRead);
+
+            request = request.substr(0, request.find('\n'));
+
+            string reply = handleRequest(request) ? "OK\n" : "ERROR\n";
+            DWORD bytesWritten = 0;
+            WriteFile(pipe, reply.c_str(), (DWORD) reply.length(), &bytesWritten, NULL);
+            FlushFileBuffers(pipe);
+            DisconnectNamedPipe(pipe);
+        }
+
+        CloseHandle(pipe);
+    }
+
+    return true;
+}
+
+/*********************************************************************
+ * sendRequest is the thin client side. It passes one request line to
+ * a running server and returns true if the server answered "OK".
+ ********************************************************************/
+
+bool signingServer::sendRequest(string endpoint, string request)
+{
+    if (endpoint == "")
+        endpoint = getDefaultEndpoint();
+
+    HANDLE pipe = INVALID_HANDLE_VALUE;
+
+    while (true)
+    {
+        pipe = CreateFileA(endpoint.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+
+        if (pipe != INVALID_HANDLE_VALUE)
+            break;
+
+        if (GetLastError() != ERROR_PIPE_BUSY || !WaitNamedPipeA(endpoint.c_str(), 5000))
+        {
+            cerr << "Could not connect to the signing server!" << endl;
+            return false;
+        }
+    }
+
+    request += "\n";
+    DWORD bytesWritten = 0;
+    WriteFile(pipe, request.c_str(), (DWORD) request.length(), &bytesWritten, NULL);
+
+    string reply = "";
+    char buffer[64];
+    DWORD bytesRead = 0;
+
+    while (ReadFile(pipe, buffer, sizeof(buffer), &bytesRead, NULL) && bytesRead > 0)
+        reply.append(buffer, bytesRead);
+
+    CloseHandle(pipe);
+
+    return (reply == "OK\n");
+}
+
+#else
+
+/*************************************************************************
+ * getDefaultEndpoint returns the socket path used if none is set. It is
+ * in $XDG_RUNTIME_DIR, which belongs to the user alone, or failing that
+ * in a directory of their own under /tmp, made here if need be.
+ * It returns an empty string if that directory is not private to them.
+ ************************************************************************/
+
+string signingServer::getDefaultEndpoint()
+{
+    const char* runtimeDirectory = getenv("XDG_RUNTIME_DIR");
+
+    if (runtimeDirectory != NULL && runtimeDirectory[0] != '\0')
+        return string(runtimeDirectory) + "/" + BCTT_SOCKET_NAME;
+
+    char directory[64];
+    snprintf(directory, sizeof directory, "/tmp/BCTt-%u", (unsigned int) geteuid());
+
+    if (mkdir(directory, 0700) != 0 && errno != EEXIST)
+    {
+        cerr << "Could not create the signing socket directory " << directory << endl;
+        return "";
+    }
+
+    // someone else may have made it first to catch the requests
+    struct stat directoryStatus;
+
+    if (lstat(directory, &directoryStatus) != 0 || !S_ISDIR(directoryStatus.st_mode)
+            || directoryStatus.st_uid != geteuid() || (directoryStatus.st_mode & 077) != 0)
+    {
+        cerr << "The signing socket directory " << directory << " is not private to this user!" << endl;
+        return "";
+    }
+
+    return string(directory) + "/" + BCTT_SOCKET_NAME;
+}
+
+/*********************************************************************
+ * isSameUser checks that the client at the other end of a connection
+ * runs as the same user as the server.
+ ********************************************************************/
+
+static bool isSameUser(int client)
+{
+#if defined(__linux__)
+    struct ucred credentials;
+    socklen_t length = sizeof(credentials);
+
+    if (getsockopt(client, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0)
+        return false;
+
+    return (credentials.uid == geteuid());
+#else
+    uid_t user;
+    gid_t group;
+
+    if (getpeereid(client, &user, &group) != 0)
+        return false;
+
+    return (user == geteuid());
+#endif
+}
+
+/*********************************************************************
+ * run listens on a UNIX socket and serves requests one at a time
+ * until a shutdown request is received.
+ * The socket can only be used by its owner, and a client running as
+ * anyone else is turned away.
+ * It returns false if the socket could not be set up.
+ ********************************************************************/
+
+bool signingServer::run()
+{
+    struct sockaddr_un address;
+
+    if (_endpoint == "")
+        return false;
+
+    if (_endpoint.length() >= sizeof(address.sun_path))
+    {
+        cerr << "Signing socket path is too long!" << endl;
+        return false;
+    }
+
+    // a client going away early should not take the server down with it
+    signal(SIGPIPE, SIG_IGN);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (listener < 0)
+    {
+        cerr << "Could not create the signing socket!" << endl;
+        return false;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, _endpoint.c_str(), sizeof(address.sun_path) - 1);
+
+    // only a stale socket of our own from an earlier run is cleared out
+    struct stat endpointStatus;
+
+    if (lstat(_endpoint.c_str(), &endpointStatus) == 0)
+    {
+        if (!S_ISSOCK(endpointStatus.st_mode) || endpointStatus.st_uid != geteuid())
+        {
+            cerr << "Not replacing " << _endpoint << ", it is not a signing socket of this user!" << endl;
+            close(listener);
+            return false;
+        }
+
+        unlink(_endpoint.c_str());
+    }
+
+    // nobody can connect until listen, so the socket is never open to others
+    if (bind(listener, (struct sockaddr*) &address, sizeof(address)) < 0
+            || chmod(_endpoint.c_str(), 0600) < 0 || listen(listener, 16) < 0)
+    {
+        cerr << "Could not listen on the signing socket!" << endl;
+        close(listener);
+        return false;
+    }
+
+    _running = true;
+
+    while (_running)
+    {
+        int client = accept(listener, NULL, NULL);
+
+        if (client < 0)
+            continue;
+
+        if (!isSameUser(client))
+        {
+            cerr << "Refused a signing request from another user." << endl;
+            ssize_t ignored = write(client, "ERROR\n", 6);
+            (void) ignored;
+            close(client);
+            continue;
+        }
+
+        struct timeval timeout;
+        timeout.tv_sec = CLIENT_TIMEOUT_SECONDS;
+        timeout.tv_usec = 0;
+
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        string request = "";
+        char buffer[256];
+        ssize_t bytesRead = 0;
+
+        while (request.find('\n') == string::npos && request.length() < MAX_REQUEST_LENGTH
+                && (bytesRead = read(client, buffer, sizeof(buffer))) > 0)
+            request.append(buffer, bytesRead);
+
+        request = request.substr(0, request.find('\n'));
+
+        // a client that timed out is not served, its request may be cut short
+        bool handled = (bytesRead >= 0 && handleRequest(request));
+        string reply = handled ? "OK\n" : "ERROR\n";
+        ssize_t ignored = write(client, reply.c_str(), reply.length());
+        (void) ignored;
+
+        close(client);
+    }
+
+    close(listener);
+    unlink(_endpoint.c_str());
+
+    return true;
+}
+
+/*********************************************************************
+ * sendRequest is the thin client side. It passes one request line to
+ * a running server and returns true if the server answered "OK".
+ ********************************************************************/
+
+bool signingServer::sendRequest(string endpoint, string request)
+{
+    if (endpoint == "")
+        endpoint = getDefaultEndpoint();
+
+    if (endpoint == "")
+        return false;
+
+    // a server that turns the request away may close before it is sent
+    signal(SIGPIPE, SIG_IGN);
+
+    struct sockaddr_un address;
+
+    if (endpoint.length() >= sizeof(address.sun_path))
+    {
+        cerr << "Signing socket path is too long!" << endl;
+        return false;
+    }
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (server < 0)
+    {
+        cerr << "Could not create the signing socket!" << endl;
+        return false;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, endpoint.c_str(), sizeof(address.sun_path) - 1);
+
+    if (connect(server, (struct sockaddr*) &address, sizeof(address)) < 0)
+    {
+        cerr << "Could not connect to the signing server!" << endl;
+        close(server);
+        return false;
+    }
+
+    request += "\n";
+
+    if (write(server, request.c_str(), request.length()) != (ssize_t) request.length())
+    {
+        close(server);
+        return false;
+    }
+
+    string reply = "";
+    char buffer[64];
+    ssize_t bytesRead = 0;
+
+    while ((bytesRead = read(server, buffer, sizeof(buffer))) > 0)
+        reply.append(buffer, bytesRead);
+
+    close(server);
+
+    return (reply == "OK\n");
+}
+
+#endif
@@ -0,0 +1,57 @@
+/**************************************************************************
+* File: signingServer.h
+*
+* This provides the interface for the long-running signing server.
+* The server loads a configuration file once, then listens on a local
+* UNIX socket (or a named pipe on Windows) for message file paths to
+* re-sign. The thin client side sends a path and waits for the result,
+* so Belch no longer pays for a full start-up on every message.
+* Each request is routed with whatever profiles its configWatcher holds
+* at the time, so the files can be changed while the server runs.
+*
+* Author: Hon1nbo
+***************************************************************************/
+
+#ifndef signingServer_h
+#define signingServer_h
+
+#include <string>
+#include "signingRouter.h"
+#include "configWatcher.h"
+
+using namespace std;
+
+#ifdef _WIN32
+        #define BCTT_DEFAULT_ENDPOINT "\\\\.\\pipe\\BCTt"
+#else
+        #define BCTT_SOCKET_NAME "BCTt.sock"
+#endif
+
+// called by the server for every message path it receives
+typedef bool (*signingHandler)(signingRouter&, char*);
+
+class signingServer
+{
+    public:
+            signingServer(configWatcher*, signingHandler);
+            ~signingServer();
+
+            void setEndpoint(string);
+            string getEndpoint();
+
+            bool run();
+            void stop();
+
+            static bool sendRequest(string, string);
+            static string getDefaultEndpoint();
+
+    private:
+            bool handleRequest(string);
+
+            configWatcher* _configs;
+            signingHandler _handler;
+            string _endpoint;
+            bool _running;
+};
+
+#endif
@@ -0,0 +1,268 @@
+/**************************************************************************
+* File: signingStats.cpp
+*
+* This provides the implementation for timing the stages of a signing.
+* Nothing is timed unless an output for the JSON lines has been set, so
+* a normal run only pays for one test per stage.
+* A JSON line looks like:
+*
+*   {"message":"a.txt","ok":true,"config_us":0.0,"read_us":12.0,...,"total_us":80.0}
+*
+* Author: Hon1nbo
+***************************************************************************/
+
+#include "signingStats.h"
+#include <cstring>
+
+using namespace std;
+
+static const char* const STAGE_NAMES[signingStats::STAGE_COUNT] =
+{
+    "config", "read", "extract", "digest", "encode", "write"
+};
+
+bool signingStats::_quiet = false;
+FILE* signingStats::_output = NULL;
+mutex signingStats::_outputLock;
+
+signingStats::signingStats()
+{
+    _ticksPerMicrosecond = (double) _timer.TicksPerSecond() / 1000000.0;
+    _messageCount = 0;
+    _failedCount = 0;
+
+    for (int i = 0; i < STAGE_COUNT; i++)
+    {
+        _stageStart[i] = 0;
+        _stageTime[i] = 0;
+        _stageTotal[i] = 0;
+    }
+
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+        _histogram[i] = 0;
+}
+
+signingStats::~signingStats()	{	}
+
+/******************************************************************
+ * setQuiet turns the progress output printed at every stage off,
+ * errors are still printed
+ *****************************************************************/
+
+void signingStats::setQuiet(bool quiet)
+{
+    _quiet = quiet;
+}
+
+/*********************************************************
+ * isQuiet returns true if progress output is turned off
+ ********************************************************/
+
+bool signingStats::isQuiet()
+{
+    return _quiet;
+}
+
+/*************************************************************************
+ * setOutput turns timing on and sets where the JSON lines go, "-" being
+ * stderr. Set it before any signing starts.
+ * It returns false if the file could not be opened.
+ ************************************************************************/
+
+bool signingStats::setOutput(string outputPath)
+{
+    closeOutput();
+
+    if (outputPath == "-")
+        _output = stderr;
+    else
+        _output = fopen(outputPath.c_str(), "w");
+
+    return (_output != NULL);
+}
+
+/*****************************************************
+ * isEnabled returns true if stages are being timed
+ ****************************************************/
+
+bool signingStats::isEnabled()
+{
+    return (_output != NULL);
+}
+
+/**************************************************
+ * closeOutput turns timing off and closes the file
+ *************************************************/
+
+void signingStats::closeOutput()
+{
+    if (_output != NULL && _output != stderr)
+        fclose(_output);
+
+    _output = NULL;
+}
+
+/************************************************************
+ * startStage and endStage bracket one stage of the current
+ * message. A stage may be timed more than once per message,
+ * the times add up.
+ ***********************************************************/
+
+void signingStats::startStage(signingStage stage)
+{
+    if (_output == NULL)
+        return;
+
+    _stageStart[stage] = _timer.GetCurrentTimerValue();
+}
+
+void signingStats::endStage(signingStage stage)
+{
+    if (_output == NULL)
+        return;
+
+    _stageTime[stage] += (double) (_timer.GetCurrentTimerValue() - _stageStart[stage]) / _ticksPerMicrosecond;
+}
+
+/*************************************************************************
+ * endMessage writes the JSON line for the current message, adds it to
+ * the totals and the histogram, and starts the next message from zero
+ ************************************************************************/
+
+void signingStats::endMessage(const string& message, bool signedOk)
+{
+    if (_output == NULL)
+        return;
+
+    double total = 0;
+
+    for (int i = 0; i < STAGE_COUNT; i++)
+    {
+        total += _stageTime[i];
+        _stageTotal[i] += _stageTime[i];
+    }
+
+    int bucket = 0;
+
+    for (double limit = 2; total >= limit && bucket < HISTOGRAM_BUCKETS - 1; limit *= 2)
+        bucket++;
+
+    _histogram[bucket]++;
+    _messageCount++;
+
+    if (!signedOk)
+        _failedCount++;
+
+    // the name is the only text in the line, so it is the only thing escaped
+    string name = "";
+
+    for (size_t i = 0; i < message.length(); i++)
+    {
+        char c = message[i];
+
+        if (c == '"' || c == '\\')
+        {
+            name += '\\';
+            name += c;
+        }
+        else if ((unsigned char) c < 0x20)
+        {
+            char escaped[8];
+            sprintf(escaped, "\\u%04x", (unsigned int) c);
+            name += escaped;
+        }
+        else
+            name += c;
+    }
+
+    {
+        lock_guard<mutex> guard(_outputLock);
+
+        fprintf(_output, "{\"message\":\"%s\",\"ok\":%s", name.c_str(), signedOk ? "true" : "false");
+
+        for (int i = 0; i < STAGE_COUNT; i++)
+            fprintf(_output, ",\"%s_us\":%.1f", STAGE_NAMES[i], _stageTime[i]);
+
+        fprintf(_output, ",\"total_us\":%.1f}\n", total);
+        fflush(_output);
+    }
+
+    for (int i = 0; i < STAGE_COUNT; i++)
+        _stageTime[i] = 0;
+}
+
+/*************************************************************
+ * merge adds the totals and histogram of another thread's
+ * stats to these
+ ************************************************************/
+
+void signingStats::merge(const signingStats& other)
+{
+    for (int i = 0; i < STAGE_COUNT; i++)
+        _stageTotal[i] += other._stageTotal[i];
+
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+        _histogram[i] += other._histogram[i];
+
+    _messageCount += other._messageCount;
+    _failedCount += other._failedCount;
+}
+
+/*******************************************************************
+ * getMessageCount returns the number of messages timed so far
+ ******************************************************************/
+
+size_t signingStats::getMessageCount()
+{
+    return _messageCount;
+}
+
+/*************************************************************************
+ * writeSummary prints the mean time of every stage and a histogram of
+ * whole-message latency, one row per power of two microseconds
+ ************************************************************************/
+
+void signingStats::writeSummary(FILE* output)
+{
+    if (_messageCount == 0)
+        return;
+
+    fprintf(output, "Timed %lu messages, %lu failed.\n", (unsigned long) _messageCount, (unsigned long) _failedCount);
+    fprintf(output, "%-10s %14s %12s\n", "stage", "total ms", "mean us");
+
+    for (int i = 0; i < STAGE_COUNT; i++)
+        fprintf(output, "%-10s %14.3f %12.1f\n", STAGE_NAMES[i], _stageTotal[i] / 1000.0, _stageTotal[i] / _messageCount);
+
+    int first = 0;
+    int last = HISTOGRAM_BUCKETS - 1;
+
+    while (_histogram[first] == 0)
+        first++;
+    while (_histogram[last] == 0)
+        last--;
+
+    size_t largest = 0;
+    for (int i = first; i <= last; i++)
+        if (_histogram[i] > largest)
+            largest = _histogram[i];
+
+    fprintf(output, "%-22s %10s\n", "latency us", "messages");
+
+    for (int i = first; i <= last; i++)
+    {
+        char range[32];
+        unsigned long low = (i == 0) ? 0 : (1UL << i);
+
+        if (i == HISTOGRAM_BUCKETS - 1)
+            snprintf(range, sizeof range, "%lu+", low);
+        else
+            snprintf(range, sizeof range, "%lu - %lu", low, (1UL << (i + 1)));
+
+        fprintf(output, "%-22s %10lu ", range, (unsigned long) _histogram[i]);
+
+        for (size_t bar = 0; bar < (_histogram[i] * 40 + largest - 1) / largest; bar++)
+            fputc('#', output);
+
+        fputc('\n', output);
+    }
+}
@@ -0,0 +1,77 @@
+/**************************************************************************
+* File: signingStats.h
+*
+* This provides the interface for timing the stages of a signing.
+* Each signing thread keeps its own signingStats, which adds up the time
+* spent in every stage of the current message using the Crypto++ Timer.
+* When the message is finished its times are written out as one JSON
+* line and added to a histogram of whole-message latency, which batch
+* runs print at the end.
+* It also holds the quiet switch, which turns off the progress output
+* printed at every stage.
+*
+* Author: Hon1nbo
+***************************************************************************/
+
+#ifndef signingStats_h
+#define signingStats_h
+
+#include <string>
+#include <cstdio>
+#include <mutex>
+#include "cryptopp/hrtimer.h"
+
+using namespace std;
+
+class signingStats
+{
+    public:
+            enum signingStage
+            {
+                STAGE_CONFIG,       // parsing the configuration
+                STAGE_READ,         // mapping and indexing the message
+                STAGE_EXTRACT,      // finding the parameters and old signature
+                STAGE_DIGEST,       // the algorithm chain
+                STAGE_ENCODE,       // hex or base64 encoding between stages
+                STAGE_WRITE,        // writing the signed message
+                STAGE_COUNT
+            };
+
+            // whole-message latency, in buckets of powers of two microseconds
+            enum { HISTOGRAM_BUCKETS = 32 };
+
+            signingStats();
+            ~signingStats();
+
+            static void setQuiet(bool);
+            static bool isQuiet();
+
+            static bool setOutput(string);
+            static bool isEnabled();
+            static void closeOutput();
+
+            void startStage(signingStage);
+            void endStage(signingStage);
+            void endMessage(const string&, bool);
+
+            void merge(const signingStats&);
+            size_t getMessageCount();
+            void writeSummary(FILE*);
+
+    private:
+            CryptoPP::Timer _timer;
+            CryptoPP::TimerWord _stageStart[STAGE_COUNT];
+            double _ticksPerMicrosecond;
+
+            double _stageTime[STAGE_COUNT];     // this message, in microseconds
+            double _stageTotal[STAGE_COUNT];    // every message so far
+            size_t _messageCount;
+            size_t _failedCount;
+            size_t _histogram[HISTOGRAM_BUCKETS];
+
+            static bool _quiet;
+            static FILE* _output;
+            static mutex _outputLock;
+};
+
+#endif